@@ -6,6 +6,11 @@ entity data_inv_v1_0 is
 	generic (
 		-- Users to add parameters here
 
+		-- Insert a registered skid buffer between the slave and master interface. This cuts
+		-- the combinational path from m00_axis_tready to s00_axis_tready at the cost of one
+		-- cycle of latency, without losing throughput.
+		C_REGISTERED	: boolean	:= false;
+
 		-- User parameters ends
 		-- Do not modify the parameters beyond this line
 
@@ -45,15 +50,74 @@ entity data_inv_v1_0 is
 end data_inv_v1_0;
 
 architecture arch_imp of data_inv_v1_0 is
+
+	-- Output register and skid register of the registered variant
+	signal out_valid	: std_logic;
+	signal out_data	: std_logic_vector(C_M00_AXIS_TDATA_WIDTH-1 downto 0);
+	signal out_strb	: std_logic_vector((C_M00_AXIS_TDATA_WIDTH/8)-1 downto 0);
+	signal out_last	: std_logic;
+	signal skid_valid	: std_logic;
+	signal skid_data	: std_logic_vector(C_M00_AXIS_TDATA_WIDTH-1 downto 0);
+	signal skid_strb	: std_logic_vector((C_M00_AXIS_TDATA_WIDTH/8)-1 downto 0);
+	signal skid_last	: std_logic;
+
 begin
 	-- Add user logic here
-	
+
+	assert C_S00_AXIS_TDATA_WIDTH = C_M00_AXIS_TDATA_WIDTH
+		report "data_inv: slave and master TDATA widths must match" severity failure;
+	assert C_S00_AXIS_TDATA_WIDTH = 32 or C_S00_AXIS_TDATA_WIDTH = 64 or C_S00_AXIS_TDATA_WIDTH = 128
+		report "data_inv: TDATA width must be 32, 64 or 128 bits" severity failure;
+
 	-- Invert slave interface tdata and connect directly to master interface
-	m00_axis_tvalid	<= s00_axis_tvalid;
-    m00_axis_tdata  <= not s00_axis_tdata;
-    m00_axis_tstrb  <= s00_axis_tstrb;
-    m00_axis_tlast  <= s00_axis_tlast;
-    s00_axis_tready <= m00_axis_tready;
+	gen_comb : if not C_REGISTERED generate
+		m00_axis_tvalid	<= s00_axis_tvalid;
+		m00_axis_tdata	<= not s00_axis_tdata;
+		m00_axis_tstrb	<= s00_axis_tstrb;
+		m00_axis_tlast	<= s00_axis_tlast;
+		s00_axis_tready	<= m00_axis_tready;
+	end generate gen_comb;
+
+	-- Invert slave interface tdata into an output register. While the master interface
+	-- stalls, one more beat is accepted into the skid register, so tready only depends
+	-- on registers and a beat can still be passed on every cycle.
+	gen_reg : if C_REGISTERED generate
+		m00_axis_tvalid	<= out_valid;
+		m00_axis_tdata	<= out_data;
+		m00_axis_tstrb	<= out_strb;
+		m00_axis_tlast	<= out_last;
+		s00_axis_tready	<= not skid_valid;
+
+		process(s00_axis_aclk)
+		begin
+			if rising_edge(s00_axis_aclk) then
+				if s00_axis_aresetn = '0' then
+					out_valid	<= '0';
+					skid_valid	<= '0';
+				elsif m00_axis_tready = '1' or out_valid = '0' then
+					-- The output register is free, refill it from the skid register first
+					if skid_valid = '1' then
+						out_data	<= skid_data;
+						out_strb	<= skid_strb;
+						out_last	<= skid_last;
+						out_valid	<= '1';
+						skid_valid	<= '0';
+					else
+						out_data	<= not s00_axis_tdata;
+						out_strb	<= s00_axis_tstrb;
+						out_last	<= s00_axis_tlast;
+						out_valid	<= s00_axis_tvalid;
+					end if;
+				elsif s00_axis_tvalid = '1' and skid_valid = '0' then
+					-- The output register is stalled, park the accepted beat
+					skid_data	<= not s00_axis_tdata;
+					skid_strb	<= s00_axis_tstrb;
+					skid_last	<= s00_axis_tlast;
+					skid_valid	<= '1';
+				end if;
+			end if;
+		end process;
+	end generate gen_reg;
 
 	-- User logic ends
 
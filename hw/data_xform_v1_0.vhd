@@ -0,0 +1,256 @@
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+
+-- Stream transform core with a selectable operation
+--
+-- The operation is selected through an AXI-Lite register bank:
+--   0x0  OP   (rw) Transform applied to the stream, see below
+--   0x4  KEY  (rw) Key of the XOR transform
+--   0x8  ID   (ro) C_ID, lets software check that the core is present
+--
+-- Transforms, each applied to every 32-bit lane of TDATA:
+--   0  Invert every bit, like data_inv
+--   1  Reverse the byte order
+--   2  XOR with KEY
+--   3  Running XOR checksum: every word is replaced with the XOR of all words of the
+--      packet up to and including it, so the final word holds the checksum of the packet
+--
+-- OP and KEY may only be changed between packets. The stream path is registered with
+-- a skid buffer, like data_inv with C_REGISTERED set. All interfaces share one clock.
+
+entity data_xform_v1_0 is
+	generic (
+		C_ID			: std_logic_vector(31 downto 0)	:= x"58464D01";
+		C_S00_AXI_ADDR_WIDTH	: integer	:= 4;
+		C_AXIS_TDATA_WIDTH	: integer	:= 32
+	);
+	port (
+		aclk	: in std_logic;
+		aresetn	: in std_logic;
+
+		-- Ports of Axi Slave Bus Interface S00_AXI
+		s00_axi_awaddr	: in std_logic_vector(C_S00_AXI_ADDR_WIDTH-1 downto 0);
+		s00_axi_awprot	: in std_logic_vector(2 downto 0);
+		s00_axi_awvalid	: in std_logic;
+		s00_axi_awready	: out std_logic;
+		s00_axi_wdata	: in std_logic_vector(31 downto 0);
+		s00_axi_wstrb	: in std_logic_vector(3 downto 0);
+		s00_axi_wvalid	: in std_logic;
+		s00_axi_wready	: out std_logic;
+		s00_axi_bresp	: out std_logic_vector(1 downto 0);
+		s00_axi_bvalid	: out std_logic;
+		s00_axi_bready	: in std_logic;
+		s00_axi_araddr	: in std_logic_vector(C_S00_AXI_ADDR_WIDTH-1 downto 0);
+		s00_axi_arprot	: in std_logic_vector(2 downto 0);
+		s00_axi_arvalid	: in std_logic;
+		s00_axi_arready	: out std_logic;
+		s00_axi_rdata	: out std_logic_vector(31 downto 0);
+		s00_axi_rresp	: out std_logic_vector(1 downto 0);
+		s00_axi_rvalid	: out std_logic;
+		s00_axi_rready	: in std_logic;
+
+		-- Ports of Axi Slave Bus Interface S00_AXIS
+		s00_axis_tready	: out std_logic;
+		s00_axis_tdata	: in std_logic_vector(C_AXIS_TDATA_WIDTH-1 downto 0);
+		s00_axis_tstrb	: in std_logic_vector((C_AXIS_TDATA_WIDTH/8)-1 downto 0);
+		s00_axis_tlast	: in std_logic;
+		s00_axis_tvalid	: in std_logic;
+
+		-- Ports of Axi Master Bus Interface M00_AXIS
+		m00_axis_tvalid	: out std_logic;
+		m00_axis_tdata	: out std_logic_vector(C_AXIS_TDATA_WIDTH-1 downto 0);
+		m00_axis_tstrb	: out std_logic_vector((C_AXIS_TDATA_WIDTH/8)-1 downto 0);
+		m00_axis_tlast	: out std_logic;
+		m00_axis_tready	: in std_logic
+	);
+end data_xform_v1_0;
+
+architecture arch_imp of data_xform_v1_0 is
+
+	constant OP_INVERT	: std_logic_vector(1 downto 0) := "00";
+	constant OP_BSWAP	: std_logic_vector(1 downto 0) := "01";
+	constant OP_XOR		: std_logic_vector(1 downto 0) := "10";
+	constant OP_CSUM	: std_logic_vector(1 downto 0) := "11";
+	constant LANES		: integer := C_AXIS_TDATA_WIDTH / 32;
+
+	-- Register bank
+	signal op_reg	: std_logic_vector(1 downto 0);
+	signal key_reg	: std_logic_vector(31 downto 0);
+	signal awready	: std_logic;
+	signal bvalid	: std_logic;
+	signal arready	: std_logic;
+	signal rvalid	: std_logic;
+	signal rdata	: std_logic_vector(31 downto 0);
+
+	-- Stream path
+	signal acc	: std_logic_vector(31 downto 0);	-- XOR of the packet so far
+	signal res	: std_logic_vector(C_AXIS_TDATA_WIDTH-1 downto 0);
+	signal out_valid	: std_logic;
+	signal out_data	: std_logic_vector(C_AXIS_TDATA_WIDTH-1 downto 0);
+	signal out_strb	: std_logic_vector((C_AXIS_TDATA_WIDTH/8)-1 downto 0);
+	signal out_last	: std_logic;
+	signal skid_valid	: std_logic;
+	signal skid_data	: std_logic_vector(C_AXIS_TDATA_WIDTH-1 downto 0);
+	signal skid_strb	: std_logic_vector((C_AXIS_TDATA_WIDTH/8)-1 downto 0);
+	signal skid_last	: std_logic;
+
+	-- Apply the selected transform to a beat, acc is the checksum of the preceding beats
+	function xform(op : std_logic_vector(1 downto 0); key : std_logic_vector(31 downto 0);
+	               acc : std_logic_vector(31 downto 0); d : std_logic_vector) return std_logic_vector is
+		variable r	: std_logic_vector(d'length-1 downto 0);
+		variable w	: std_logic_vector(31 downto 0);
+		variable sum	: std_logic_vector(31 downto 0) := acc;
+	begin
+		for l in 0 to d'length/32-1 loop
+			w := d(32*l+31 downto 32*l);
+			case op is
+				when OP_INVERT =>
+					r(32*l+31 downto 32*l) := not w;
+				when OP_BSWAP =>
+					r(32*l+31 downto 32*l) := w(7 downto 0) & w(15 downto 8) & w(23 downto 16) & w(31 downto 24);
+				when OP_XOR =>
+					r(32*l+31 downto 32*l) := w xor key;
+				when others =>
+					sum := sum xor w;
+					r(32*l+31 downto 32*l) := sum;
+			end case;
+		end loop;
+		return r;
+	end function;
+
+	-- XOR of all lanes of a beat
+	function fold(d : std_logic_vector) return std_logic_vector is
+		variable sum	: std_logic_vector(31 downto 0) := (others => '0');
+	begin
+		for l in 0 to d'length/32-1 loop
+			sum := sum xor d(32*l+31 downto 32*l);
+		end loop;
+		return sum;
+	end function;
+
+begin
+	assert C_AXIS_TDATA_WIDTH = 32 or C_AXIS_TDATA_WIDTH = 64 or C_AXIS_TDATA_WIDTH = 128
+		report "data_xform: TDATA width must be 32, 64 or 128 bits" severity failure;
+
+	---------------------------------------------------------------------------------
+	-- AXI-Lite register bank, one transaction at a time
+	---------------------------------------------------------------------------------
+	s00_axi_awready	<= awready;
+	s00_axi_wready	<= awready;
+	s00_axi_bresp	<= "00";
+	s00_axi_bvalid	<= bvalid;
+	s00_axi_arready	<= arready;
+	s00_axi_rdata	<= rdata;
+	s00_axi_rresp	<= "00";
+	s00_axi_rvalid	<= rvalid;
+
+	process(aclk)
+	begin
+		if rising_edge(aclk) then
+			if aresetn = '0' then
+				awready	<= '0';
+				bvalid	<= '0';
+				arready	<= '0';
+				rvalid	<= '0';
+				op_reg	<= OP_INVERT;
+				key_reg	<= (others => '0');
+			else
+				-- Address and data are accepted together, the response follows the handshake
+				if awready = '1' then
+					awready	<= '0';
+					bvalid	<= '1';
+					case s00_axi_awaddr(3 downto 2) is
+						when "00" =>
+							if s00_axi_wstrb(0) = '1' then
+								op_reg <= s00_axi_wdata(1 downto 0);
+							end if;
+						when "01" =>
+							for b in 0 to 3 loop
+								if s00_axi_wstrb(b) = '1' then
+									key_reg(8*b+7 downto 8*b) <= s00_axi_wdata(8*b+7 downto 8*b);
+								end if;
+							end loop;
+						when others =>
+							null;
+					end case;
+				elsif s00_axi_awvalid = '1' and s00_axi_wvalid = '1' and bvalid = '0' then
+					awready	<= '1';
+				end if;
+				if bvalid = '1' and s00_axi_bready = '1' then
+					bvalid	<= '0';
+				end if;
+
+				if arready = '1' then
+					arready	<= '0';
+					rvalid	<= '1';
+					case s00_axi_araddr(3 downto 2) is
+						when "00" =>	rdata <= std_logic_vector(resize(unsigned(op_reg), 32));
+						when "01" =>	rdata <= key_reg;
+						when "10" =>	rdata <= C_ID;
+						when others =>	rdata <= (others => '0');
+					end case;
+				elsif s00_axi_arvalid = '1' and rvalid = '0' then
+					arready	<= '1';
+				end if;
+				if rvalid = '1' and s00_axi_rready = '1' then
+					rvalid	<= '0';
+				end if;
+			end if;
+		end if;
+	end process;
+
+	---------------------------------------------------------------------------------
+	-- Stream path, an output register with a skid register behind it
+	---------------------------------------------------------------------------------
+	res	<= xform(op_reg, key_reg, acc, s00_axis_tdata);
+
+	m00_axis_tvalid	<= out_valid;
+	m00_axis_tdata	<= out_data;
+	m00_axis_tstrb	<= out_strb;
+	m00_axis_tlast	<= out_last;
+	s00_axis_tready	<= not skid_valid;
+
+	process(aclk)
+	begin
+		if rising_edge(aclk) then
+			if aresetn = '0' then
+				out_valid	<= '0';
+				skid_valid	<= '0';
+				acc		<= (others => '0');
+			else
+				-- Track the checksum of the packet over every accepted beat
+				if s00_axis_tvalid = '1' and skid_valid = '0' then
+					if s00_axis_tlast = '1' then
+						acc <= (others => '0');
+					else
+						acc <= acc xor fold(s00_axis_tdata);
+					end if;
+				end if;
+
+				if m00_axis_tready = '1' or out_valid = '0' then
+					-- The output register is free, refill it from the skid register first
+					if skid_valid = '1' then
+						out_data	<= skid_data;
+						out_strb	<= skid_strb;
+						out_last	<= skid_last;
+						out_valid	<= '1';
+						skid_valid	<= '0';
+					else
+						out_data	<= res;
+						out_strb	<= s00_axis_tstrb;
+						out_last	<= s00_axis_tlast;
+						out_valid	<= s00_axis_tvalid;
+					end if;
+				elsif s00_axis_tvalid = '1' and skid_valid = '0' then
+					-- The output register is stalled, park the accepted beat
+					skid_data	<= res;
+					skid_strb	<= s00_axis_tstrb;
+					skid_last	<= s00_axis_tlast;
+					skid_valid	<= '1';
+				end if;
+			end if;
+		end if;
+	end process;
+
+end arch_imp;
@@ -0,0 +1,162 @@
+-- Testbench for data_inv_v1_0
+--
+-- Streams G_BEATS beats through the core with random gaps on the slave interface and
+-- random backpressure on the master interface, checks every beat that comes out, and
+-- reports the achieved throughput in beats per cycle.
+
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+use ieee.math_real.all;
+
+entity data_inv_tb is
+	generic (
+		G_WIDTH		: integer	:= 32;		-- TDATA width of the core
+		G_REGISTERED	: boolean	:= false;	-- C_REGISTERED of the core
+		G_VALID_PCT	: integer	:= 70;		-- Probability that the source offers a beat
+		G_READY_PCT	: integer	:= 70;		-- Probability that the sink accepts a beat
+		G_BEATS		: integer	:= 10000;	-- Number of beats to stream
+		G_PKT_LEN	: integer	:= 16		-- Beats per packet, tlast marks the final one
+	);
+end data_inv_tb;
+
+architecture sim of data_inv_tb is
+
+	constant CLK_PERIOD	: time := 10 ns;
+
+	signal clk	: std_logic := '0';
+	signal rstn	: std_logic := '0';
+	signal done	: boolean := false;
+
+	signal s_valid	: std_logic := '0';
+	signal s_ready	: std_logic;
+	signal s_data	: std_logic_vector(G_WIDTH-1 downto 0) := (others => '0');
+	signal s_strb	: std_logic_vector(G_WIDTH/8-1 downto 0) := (others => '1');
+	signal s_last	: std_logic := '0';
+
+	signal m_valid	: std_logic;
+	signal m_ready	: std_logic := '0';
+	signal m_data	: std_logic_vector(G_WIDTH-1 downto 0);
+	signal m_strb	: std_logic_vector(G_WIDTH/8-1 downto 0);
+	signal m_last	: std_logic;
+
+	-- Data of a beat: its index and the number of the 32-bit word within the beat
+	function pattern(idx : natural) return std_logic_vector is
+		variable v : std_logic_vector(G_WIDTH-1 downto 0);
+	begin
+		for w in 0 to G_WIDTH/32-1 loop
+			v(32*w+31 downto 32*w) := std_logic_vector(to_unsigned(idx mod 2**24, 24))
+									& std_logic_vector(to_unsigned(w, 8));
+		end loop;
+		return v;
+	end function;
+
+	function is_last(idx : natural) return std_logic is
+	begin
+		if idx mod G_PKT_LEN = G_PKT_LEN-1 then
+			return '1';
+		end if;
+		return '0';
+	end function;
+
+begin
+
+	dut : entity work.data_inv_v1_0
+		generic map (
+			C_REGISTERED		=> G_REGISTERED,
+			C_S00_AXIS_TDATA_WIDTH	=> G_WIDTH,
+			C_M00_AXIS_TDATA_WIDTH	=> G_WIDTH
+		)
+		port map (
+			s00_axis_aclk		=> clk,
+			s00_axis_aresetn	=> rstn,
+			s00_axis_tready		=> s_ready,
+			s00_axis_tdata		=> s_data,
+			s00_axis_tstrb		=> s_strb,
+			s00_axis_tlast		=> s_last,
+			s00_axis_tvalid		=> s_valid,
+			m00_axis_aclk		=> clk,
+			m00_axis_aresetn	=> rstn,
+			m00_axis_tvalid		=> m_valid,
+			m00_axis_tdata		=> m_data,
+			m00_axis_tstrb		=> m_strb,
+			m00_axis_tlast		=> m_last,
+			m00_axis_tready		=> m_ready
+		);
+
+	clk <= not clk after CLK_PERIOD/2 when not done;
+
+	-- Offer the beats in order, holding each one until it has been accepted
+	source : process(clk)
+		variable seed1	: positive := 1;
+		variable seed2	: positive := 7;
+		variable r	: real;
+		variable idx	: natural := 0;
+	begin
+		if rising_edge(clk) then
+			if rstn = '0' then
+				s_valid <= '0';
+			elsif s_valid = '0' or s_ready = '1' then
+				s_valid <= '0';
+				if idx < G_BEATS then
+					uniform(seed1, seed2, r);
+					if r < real(G_VALID_PCT) / 100.0 then
+						s_valid	<= '1';
+						s_data	<= pattern(idx);
+						s_last	<= is_last(idx);
+						idx := idx + 1;
+					end if;
+				end if;
+			end if;
+		end if;
+	end process;
+
+	-- Check every beat that is accepted and measure the time until the last one
+	sink : process(clk)
+		variable seed1	: positive := 3;
+		variable seed2	: positive := 11;
+		variable r	: real;
+		variable idx	: natural := 0;
+		variable cycles	: natural := 0;
+	begin
+		if rising_edge(clk) then
+			if rstn = '0' then
+				m_ready <= '0';
+			elsif not done then
+				cycles := cycles + 1;
+				if m_valid = '1' and m_ready = '1' then
+					assert m_data = not pattern(idx)
+						report "data_inv_tb: wrong data in beat " & integer'image(idx) severity failure;
+					assert m_strb = (m_strb'range => '1')
+						report "data_inv_tb: wrong tstrb in beat " & integer'image(idx) severity failure;
+					assert m_last = is_last(idx)
+						report "data_inv_tb: wrong tlast in beat " & integer'image(idx) severity failure;
+					idx := idx + 1;
+				end if;
+
+				if idx = G_BEATS then
+					report "data_inv_tb: width=" & integer'image(G_WIDTH)
+						& " registered=" & boolean'image(G_REGISTERED)
+						& " valid=" & integer'image(G_VALID_PCT) & "%"
+						& " ready=" & integer'image(G_READY_PCT) & "%"
+						& " beats=" & integer'image(G_BEATS)
+						& " cycles=" & integer'image(cycles)
+						& " beats/cycle=" & real'image(real(G_BEATS) / real(cycles));
+					done <= true;
+				end if;
+				assert cycles < 100 * G_BEATS
+					report "data_inv_tb: stream stalled after " & integer'image(idx) & " beats" severity failure;
+
+				uniform(seed1, seed2, r);
+				if r < real(G_READY_PCT) / 100.0 then
+					m_ready <= '1';
+				else
+					m_ready <= '0';
+				end if;
+			end if;
+		end if;
+	end process;
+
+	rstn <= '1' after 5 * CLK_PERIOD;
+
+end sim;
@@ -0,0 +1,297 @@
+-- Testbench for data_xform_v1_0
+--
+-- Selects every transform in turn through the AXI-Lite registers and streams G_BEATS
+-- beats through the core under random gaps and backpressure. Every beat that comes
+-- out is checked against a word-by-word model of the transform.
+
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+use ieee.math_real.all;
+
+entity data_xform_tb is
+	generic (
+		G_WIDTH		: integer	:= 32;		-- TDATA width of the core
+		G_VALID_PCT	: integer	:= 70;		-- Probability that the source offers a beat
+		G_READY_PCT	: integer	:= 70;		-- Probability that the sink accepts a beat
+		G_BEATS		: integer	:= 4096;	-- Number of beats to stream per transform
+		G_PKT_LEN	: integer	:= 16;		-- Beats per packet, tlast marks the final one
+		G_KEY		: integer	:= 16#5A3C0F1E#	-- Key of the XOR transform
+	);
+end data_xform_tb;
+
+architecture sim of data_xform_tb is
+
+	constant CLK_PERIOD	: time := 10 ns;
+	constant LANES		: integer := G_WIDTH / 32;
+
+	signal clk	: std_logic := '0';
+	signal rstn	: std_logic := '0';
+	signal done	: boolean := false;
+
+	-- Index of the transform being streamed, and of the last one fully received
+	signal phase	: integer := -1;
+	signal received	: integer := -1;
+
+	signal awaddr	: std_logic_vector(3 downto 0) := (others => '0');
+	signal awvalid	: std_logic := '0';
+	signal awready	: std_logic;
+	signal wdata	: std_logic_vector(31 downto 0) := (others => '0');
+	signal wvalid	: std_logic := '0';
+	signal wready	: std_logic;
+	signal bvalid	: std_logic;
+	signal bready	: std_logic := '0';
+	signal araddr	: std_logic_vector(3 downto 0) := (others => '0');
+	signal arvalid	: std_logic := '0';
+	signal arready	: std_logic;
+	signal rdata	: std_logic_vector(31 downto 0);
+	signal rvalid	: std_logic;
+	signal rready	: std_logic := '0';
+
+	signal s_valid	: std_logic := '0';
+	signal s_ready	: std_logic;
+	signal s_data	: std_logic_vector(G_WIDTH-1 downto 0) := (others => '0');
+	signal s_strb	: std_logic_vector(G_WIDTH/8-1 downto 0) := (others => '1');
+	signal s_last	: std_logic := '0';
+
+	signal m_valid	: std_logic;
+	signal m_ready	: std_logic := '0';
+	signal m_data	: std_logic_vector(G_WIDTH-1 downto 0);
+	signal m_strb	: std_logic_vector(G_WIDTH/8-1 downto 0);
+	signal m_last	: std_logic;
+
+	-- Input word of a lane, a hash of beat and lane so that every byte differs
+	function word(idx : natural; lane : natural) return std_logic_vector is
+		variable x : unsigned(31 downto 0);
+	begin
+		x := to_unsigned((idx * LANES + lane) mod 2**16, 16) * to_unsigned(40503, 16);
+		return std_logic_vector(x xor rotate_left(x, 13));
+	end function;
+
+	function pattern(idx : natural) return std_logic_vector is
+		variable v : std_logic_vector(G_WIDTH-1 downto 0);
+	begin
+		for l in 0 to LANES-1 loop
+			v(32*l+31 downto 32*l) := word(idx, l);
+		end loop;
+		return v;
+	end function;
+
+	function is_last(idx : natural) return std_logic is
+	begin
+		if idx mod G_PKT_LEN = G_PKT_LEN-1 then
+			return '1';
+		end if;
+		return '0';
+	end function;
+
+begin
+
+	assert G_BEATS mod G_PKT_LEN = 0
+		report "data_xform_tb: G_BEATS must be a multiple of G_PKT_LEN" severity failure;
+
+	dut : entity work.data_xform_v1_0
+		generic map (
+			C_AXIS_TDATA_WIDTH	=> G_WIDTH
+		)
+		port map (
+			aclk		=> clk,
+			aresetn		=> rstn,
+			s00_axi_awaddr	=> awaddr,
+			s00_axi_awprot	=> "000",
+			s00_axi_awvalid	=> awvalid,
+			s00_axi_awready	=> awready,
+			s00_axi_wdata	=> wdata,
+			s00_axi_wstrb	=> "1111",
+			s00_axi_wvalid	=> wvalid,
+			s00_axi_wready	=> wready,
+			s00_axi_bresp	=> open,
+			s00_axi_bvalid	=> bvalid,
+			s00_axi_bready	=> bready,
+			s00_axi_araddr	=> araddr,
+			s00_axi_arprot	=> "000",
+			s00_axi_arvalid	=> arvalid,
+			s00_axi_arready	=> arready,
+			s00_axi_rdata	=> rdata,
+			s00_axi_rresp	=> open,
+			s00_axi_rvalid	=> rvalid,
+			s00_axi_rready	=> rready,
+			s00_axis_tready	=> s_ready,
+			s00_axis_tdata	=> s_data,
+			s00_axis_tstrb	=> s_strb,
+			s00_axis_tlast	=> s_last,
+			s00_axis_tvalid	=> s_valid,
+			m00_axis_tvalid	=> m_valid,
+			m00_axis_tdata	=> m_data,
+			m00_axis_tstrb	=> m_strb,
+			m00_axis_tlast	=> m_last,
+			m00_axis_tready	=> m_ready
+		);
+
+	clk <= not clk after CLK_PERIOD/2 when not done;
+	rstn <= '1' after 5 * CLK_PERIOD;
+
+	-- Program each transform and wait until its stream has been checked
+	control : process
+		variable data : std_logic_vector(31 downto 0);
+
+		procedure axi_write(addr : integer; value : std_logic_vector(31 downto 0)) is
+		begin
+			awaddr	<= std_logic_vector(to_unsigned(addr, 4));
+			wdata	<= value;
+			awvalid	<= '1';
+			wvalid	<= '1';
+			loop
+				wait until rising_edge(clk);
+				exit when awready = '1' and wready = '1';
+			end loop;
+			awvalid	<= '0';
+			wvalid	<= '0';
+			bready	<= '1';
+			loop
+				wait until rising_edge(clk);
+				exit when bvalid = '1';
+			end loop;
+			bready	<= '0';
+		end procedure;
+
+		procedure axi_read(addr : integer; value : out std_logic_vector(31 downto 0)) is
+		begin
+			araddr	<= std_logic_vector(to_unsigned(addr, 4));
+			arvalid	<= '1';
+			loop
+				wait until rising_edge(clk);
+				exit when arready = '1';
+			end loop;
+			arvalid	<= '0';
+			rready	<= '1';
+			loop
+				wait until rising_edge(clk);
+				exit when rvalid = '1';
+			end loop;
+			value	:= rdata;
+			rready	<= '0';
+		end procedure;
+
+	begin
+		wait until rstn = '1';
+		wait until rising_edge(clk);
+
+		axi_read(8, data);
+		assert data = x"58464D01" report "data_xform_tb: wrong ID register" severity failure;
+
+		for op in 0 to 3 loop
+			axi_write(0, std_logic_vector(to_unsigned(op, 32)));
+			axi_write(4, std_logic_vector(to_signed(G_KEY, 32)));
+			axi_read(0, data);
+			assert to_integer(unsigned(data)) = op report "data_xform_tb: OP register not written" severity failure;
+
+			phase <= op;
+			wait until received = op;
+		end loop;
+
+		report "data_xform_tb: width=" & integer'image(G_WIDTH) & " all transforms passed";
+		done <= true;
+		wait;
+	end process;
+
+	-- Offer the beats of the current phase in order, holding each one until it has been accepted
+	source : process(clk)
+		variable seed1	: positive := 1;
+		variable seed2	: positive := 7;
+		variable r	: real;
+		variable idx	: natural := 0;
+		variable cur	: integer := -1;
+	begin
+		if rising_edge(clk) then
+			if phase /= cur then
+				cur := phase;
+				idx := 0;
+			end if;
+
+			if rstn = '0' or cur < 0 then
+				s_valid <= '0';
+			elsif s_valid = '0' or s_ready = '1' then
+				s_valid <= '0';
+				if idx < G_BEATS then
+					uniform(seed1, seed2, r);
+					if r < real(G_VALID_PCT) / 100.0 then
+						s_valid	<= '1';
+						s_data	<= pattern(idx);
+						s_last	<= is_last(idx);
+						idx := idx + 1;
+					end if;
+				end if;
+			end if;
+		end if;
+	end process;
+
+	-- Check every beat of the current phase against the model
+	sink : process(clk)
+		variable seed1	: positive := 3;
+		variable seed2	: positive := 11;
+		variable r	: real;
+		variable idx	: natural := 0;
+		variable cur	: integer := -1;
+		variable cycles	: natural := 0;
+		variable sum	: std_logic_vector(31 downto 0);
+		variable w, expect	: std_logic_vector(31 downto 0);
+		variable key	: std_logic_vector(31 downto 0);
+	begin
+		if rising_edge(clk) then
+			if phase /= cur then
+				cur := phase;
+				idx := 0;
+				cycles := 0;
+				sum := (others => '0');
+			end if;
+
+			if rstn = '0' or cur < 0 then
+				m_ready <= '0';
+			elsif idx < G_BEATS then
+				cycles := cycles + 1;
+				key := std_logic_vector(to_signed(G_KEY, 32));
+				if m_valid = '1' and m_ready = '1' then
+					for l in 0 to LANES-1 loop
+						w := word(idx, l);
+						case cur is
+							when 0 =>	expect := not w;
+							when 1 =>	expect := w(7 downto 0) & w(15 downto 8) & w(23 downto 16) & w(31 downto 24);
+							when 2 =>	expect := w xor key;
+							when others =>
+								sum := sum xor w;
+								expect := sum;
+						end case;
+						assert m_data(32*l+31 downto 32*l) = expect
+							report "data_xform_tb: op " & integer'image(cur) & ", wrong data in beat "
+								& integer'image(idx) & " lane " & integer'image(l) severity failure;
+					end loop;
+					assert m_last = is_last(idx)
+						report "data_xform_tb: wrong tlast in beat " & integer'image(idx) severity failure;
+					if is_last(idx) = '1' then
+						sum := (others => '0');
+					end if;
+					idx := idx + 1;
+				end if;
+
+				if idx = G_BEATS then
+					report "data_xform_tb: width=" & integer'image(G_WIDTH)
+						& " op=" & integer'image(cur)
+						& " cycles=" & integer'image(cycles)
+						& " beats/cycle=" & real'image(real(G_BEATS) / real(cycles));
+					received <= cur;
+				end if;
+				assert cycles < 100 * G_BEATS
+					report "data_xform_tb: stream stalled after " & integer'image(idx) & " beats" severity failure;
+
+				uniform(seed1, seed2, r);
+				if r < real(G_READY_PCT) / 100.0 then
+					m_ready <= '1';
+				else
+					m_ready <= '0';
+				end if;
+			end if;
+		end if;
+	end process;
+
+end sim;
@@ -0,0 +1,24 @@
+#!/bin/sh
+# Run the data_inv testbench for every supported width, with and without the skid
+# buffer, once at full rate and once with random gaps and backpressure. The data_xform
+# testbench then checks every transform at every width.
+set -e
+cd "$(dirname "$0")"
+
+GHDL=${GHDL:-ghdl}
+$GHDL -a --std=08 ../data_inv_v1_0.vhd data_inv_tb.vhd ../data_xform_v1_0.vhd data_xform_tb.vhd
+$GHDL -e --std=08 data_inv_tb
+$GHDL -e --std=08 data_xform_tb
+
+for width in 32 64 128; do
+    for registered in false true; do
+        for pct in 100 70; do
+            $GHDL -r --std=08 data_inv_tb -gG_WIDTH=$width -gG_REGISTERED=$registered \
+                -gG_VALID_PCT=$pct -gG_READY_PCT=$pct
+        done
+    done
+done
+
+for width in 32 64 128; do
+    $GHDL -r --std=08 data_xform_tb -gG_WIDTH=$width
+done
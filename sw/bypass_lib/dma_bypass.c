@@ -0,0 +1,199 @@
+#include <errno.h>      // errno
+#include <fcntl.h>      // open
+#include <unistd.h>     // close
+#include <sys/ioctl.h>  // ioctl
+#include <sys/mman.h>   // mmap/munmap
+#include "dma_bypass.h"
+
+/************************************************************************************
+* Register access
+************************************************************************************/
+
+// Write a word to the specified register
+static inline void reg_wr(struct dma_bypass *dev, uint32_t val, uint32_t reg_num) {
+    dev->regs[reg_num / sizeof(uint32_t)] = val;
+}
+
+// Read a word from the specified register
+static inline uint32_t reg_rd(struct dma_bypass *dev, uint32_t reg_num) {
+    return dev->regs[reg_num / sizeof(uint32_t)];
+}
+
+
+/************************************************************************************
+* Library functions
+************************************************************************************/
+
+/**
+ * dma_bypass_open - Take over the core through the driver
+ *
+ * @dev: The handle to fill in
+ * @path: Path of the device file, usually /dev/dma_proxy
+ *
+ * The driver must have been loaded with allow_bypass=1, and the calling process
+ * needs CAP_SYS_RAWIO. Other users of the driver are blocked until dma_bypass_close().
+ *
+ * This function returns zero in case of success, and a negative errno otherwise.
+ */
+int dma_bypass_open(struct dma_bypass *dev, const char *path) {
+    struct dma_proxy_bypass_info info;
+    void *regs;
+    int err;
+
+    dev->fd = open(path, O_RDWR);
+    if (dev->fd < 0)
+        return -errno;
+
+    if (ioctl(dev->fd, DMAPROXY_IOCTBYPASS, &info) < 0)
+        goto err_close;
+
+    regs = mmap(NULL, info.regs_size, PROT_READ | PROT_WRITE, MAP_SHARED, dev->fd, info.regs_offset);
+    if (regs == MAP_FAILED)
+        goto err_close;
+
+    dev->regs = (volatile uint32_t *)regs;
+    dev->regs_size = info.regs_size;
+    dev->addr_width = info.addr_width;
+    return 0;
+
+err_close:
+    err = -errno;
+    close(dev->fd);
+    dev->fd = -1;
+    return err;
+}
+
+/**
+ * dma_bypass_close - Hand the core back to the driver
+ *
+ * @dev: The handle returned by dma_bypass_open()
+ *
+ * Buffers that have not been removed are freed by the driver. The core is reset
+ * when the file descriptor is closed.
+ */
+void dma_bypass_close(struct dma_bypass *dev) {
+    munmap((void *)dev->regs, dev->regs_size);
+    close(dev->fd);
+    dev->fd = -1;
+    dev->regs = NULL;
+}
+
+/**
+ * dma_bypass_buf_new - Create a DMA buffer and map it
+ *
+ * @dev: The handle returned by dma_bypass_open()
+ * @buf: Returns the buffer
+ * @size: Size of the buffer in bytes
+ *
+ * This function returns zero in case of success, and a negative errno otherwise.
+ */
+int dma_bypass_buf_new(struct dma_bypass *dev, struct dma_bypass_buf *buf, size_t size) {
+    struct dma_proxy_buf_req req = {.size = size};
+    struct dma_proxy_buf_info info = {0};
+    int err;
+
+    if (ioctl(dev->fd, DMAPROXY_IOCTBUFNEW, &req) < 0)
+        return -errno;
+
+    info.handle = req.handle;
+    if (ioctl(dev->fd, DMAPROXY_IOCTBUFINFO, &info) < 0)
+        goto err_del;
+
+    buf->virt = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, dev->fd, info.offset);
+    if (buf->virt == MAP_FAILED)
+        goto err_del;
+
+    buf->handle = req.handle;
+    buf->size = size;
+    buf->dma_addr = info.dma_addr;
+    return 0;
+
+err_del:
+    err = -errno;
+    ioctl(dev->fd, DMAPROXY_IOCTBUFDEL, &req.handle);
+    return err;
+}
+
+/**
+ * dma_bypass_buf_del - Unmap and remove a DMA buffer
+ *
+ * @dev: The handle returned by dma_bypass_open()
+ * @buf: The buffer created by dma_bypass_buf_new()
+ *
+ * The buffer must not be the target of a transfer that is still running.
+ */
+void dma_bypass_buf_del(struct dma_bypass *dev, struct dma_bypass_buf *buf) {
+    munmap(buf->virt, buf->size);
+    ioctl(dev->fd, DMAPROXY_IOCTBUFDEL, &buf->handle);
+    buf->virt = NULL;
+}
+
+/**
+ * dma_bypass_start - Start a transfer from one buffer through the stream core into another
+ *
+ * @dev: The handle returned by dma_bypass_open()
+ * @src: The buffer that is sent to the core (MM2S)
+ * @dst: The buffer that receives the result (S2MM)
+ * @len: Number of bytes to transfer
+ *
+ * The S2MM channel is armed first so that no output of the core is lost. Writing
+ * the length registers starts the channels.
+ *
+ * This function returns zero in case of success, and a negative errno otherwise.
+ */
+int dma_bypass_start(struct dma_bypass *dev, const struct dma_bypass_buf *src,
+                     const struct dma_bypass_buf *dst, size_t len) {
+    if (!len || len > src->size || len > dst->size)
+        return -EINVAL;
+
+    // Acknowledge the previous transfer
+    reg_wr(dev, (uint32_t)1 << AXI_DMASR_IOC_Irq, AXI_S2MM_DMASR);
+    reg_wr(dev, (uint32_t)1 << AXI_DMASR_IOC_Irq, AXI_MM2S_DMASR);
+
+    reg_wr(dev, (uint32_t)1 << AXI_DMACR_RS, AXI_S2MM_DMACR);
+    reg_wr(dev, (uint32_t)dst->dma_addr, AXI_S2MM_DA);
+    if (dev->addr_width > 32)
+        reg_wr(dev, (uint32_t)(dst->dma_addr >> 32), AXI_S2MM_DA_MSB);
+
+    reg_wr(dev, (uint32_t)1 << AXI_DMACR_RS, AXI_MM2S_DMACR);
+    reg_wr(dev, (uint32_t)src->dma_addr, AXI_MM2S_SA);
+    if (dev->addr_width > 32)
+        reg_wr(dev, (uint32_t)(src->dma_addr >> 32), AXI_MM2S_SA_MSB);
+
+    // The source data must reach memory before the core starts reading it
+    __sync_synchronize();
+    reg_wr(dev, (uint32_t)len, AXI_S2MM_LENGTH);
+    reg_wr(dev, (uint32_t)len, AXI_MM2S_LENGTH);
+    return 0;
+}
+
+/**
+ * dma_bypass_wait - Busy-wait for the transfer started last
+ *
+ * @dev: The handle returned by dma_bypass_open()
+ * @max_polls: Number of status reads before giving up, zero to wait forever
+ *
+ * This function returns zero once both channels have completed, -EIO if a channel
+ * reported an error, and -ETIMEDOUT if max_polls was exhausted.
+ */
+int dma_bypass_wait(struct dma_bypass *dev, unsigned long max_polls) {
+    const uint32_t done = ((uint32_t)1 << AXI_DMASR_Idle) | ((uint32_t)1 << AXI_DMASR_IOC_Irq);
+    const uint32_t errs = ((uint32_t)1 << AXI_DMASR_DMAIntErr) | ((uint32_t)1 << AXI_DMASR_DMASlvErr)
+                        | ((uint32_t)1 << AXI_DMASR_DMADecErr);
+    uint32_t mm2s, s2mm;
+    unsigned long i;
+
+    for (i = 0; !max_polls || i < max_polls; i++) {
+        mm2s = reg_rd(dev, AXI_MM2S_DMASR);
+        s2mm = reg_rd(dev, AXI_S2MM_DMASR);
+        if ((mm2s | s2mm) & errs)
+            return -EIO;
+        if ((mm2s & done) == done && (s2mm & done) == done) {
+            // Results must not be read before the core has signalled completion
+            __sync_synchronize();
+            return 0;
+        }
+    }
+
+    return -ETIMEDOUT;
+}
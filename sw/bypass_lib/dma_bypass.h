@@ -0,0 +1,89 @@
+#ifndef __DMA_BYPASS_H_
+#define __DMA_BYPASS_H_
+
+#include <stddef.h>     // size_t
+#include <stdint.h>     // uintX_t
+#include <sys/ioctl.h>  // _IOWR and friends
+
+/************************************************************************************
+* Driver interface (see sw/driver/dma_proxy_driver.h)
+************************************************************************************/
+#define DMAPROXY_IOCTMAGIC      0x89
+#define DMAPROXY_IOCTBUFNEW     _IOWR(DMAPROXY_IOCTMAGIC, 7, struct dma_proxy_buf_req)
+#define DMAPROXY_IOCTBUFDEL     _IOW(DMAPROXY_IOCTMAGIC, 8, unsigned int)
+#define DMAPROXY_IOCTBUFINFO    _IOWR(DMAPROXY_IOCTMAGIC, 10, struct dma_proxy_buf_info)
+#define DMAPROXY_IOCTBYPASS     _IOR(DMAPROXY_IOCTMAGIC, 11, struct dma_proxy_bypass_info)
+
+struct dma_proxy_buf_req {
+    unsigned long long size;
+    unsigned long long offset;
+    unsigned int handle;
+    unsigned int rsvd;
+};
+
+struct dma_proxy_buf_info {
+    unsigned int handle;
+    unsigned int rsvd;
+    unsigned long long size;
+    unsigned long long offset;
+    unsigned long long dma_addr;
+};
+
+struct dma_proxy_bypass_info {
+    unsigned long long regs_offset;
+    unsigned int regs_size;
+    unsigned int addr_width;
+};
+
+
+/************************************************************************************
+* AXI DMA register-related defines (see Table 2-7 in AXI DMA documentation)
+************************************************************************************/
+#define AXI_MM2S_DMACR          0x00
+#define AXI_MM2S_DMASR          0x04
+#define AXI_MM2S_SA             0x18
+#define AXI_MM2S_SA_MSB         0x1C
+#define AXI_MM2S_LENGTH         0x28
+#define AXI_S2MM_DMACR          0x30
+#define AXI_S2MM_DMASR          0x34
+#define AXI_S2MM_DA             0x48
+#define AXI_S2MM_DA_MSB         0x4C
+#define AXI_S2MM_LENGTH         0x58
+
+#define AXI_DMACR_RS            0
+#define AXI_DMASR_Idle          1
+#define AXI_DMASR_DMAIntErr     4
+#define AXI_DMASR_DMASlvErr     5
+#define AXI_DMASR_DMADecErr     6
+#define AXI_DMASR_IOC_Irq       12
+
+
+/************************************************************************************
+* Library interface
+************************************************************************************/
+
+// A file descriptor of the driver that has taken over the core
+struct dma_bypass {
+    int                 fd;
+    volatile uint32_t   *regs;          // Mapped register window of the core
+    size_t              regs_size;
+    unsigned int        addr_width;     // Width of the core's address bus in bits
+};
+
+// A DMA buffer, mapped into the process, together with its bus address
+struct dma_bypass_buf {
+    unsigned int        handle;
+    size_t              size;
+    void                *virt;
+    uint64_t            dma_addr;
+};
+
+int dma_bypass_open(struct dma_bypass *dev, const char *path);
+void dma_bypass_close(struct dma_bypass *dev);
+int dma_bypass_buf_new(struct dma_bypass *dev, struct dma_bypass_buf *buf, size_t size);
+void dma_bypass_buf_del(struct dma_bypass *dev, struct dma_bypass_buf *buf);
+int dma_bypass_start(struct dma_bypass *dev, const struct dma_bypass_buf *src,
+                     const struct dma_bypass_buf *dst, size_t len);
+int dma_bypass_wait(struct dma_bypass *dev, unsigned long max_polls);
+
+#endif  // __DMA_BYPASS_H_
@@ -0,0 +1,187 @@
+#include <errno.h>      // errno
+#include <signal.h>     // sigaction
+#include <stdio.h>      // fopen/fgets
+#include <stdlib.h>     // strtol
+#include <string.h>     // strstr
+#include <unistd.h>     // getopt/alarm
+#include "dma_trace.h"
+
+#define DEF_TRACEFS     "/sys/kernel/tracing"
+#define SUBMIT_EVENT    "events/dma_proxy/dma_proxy_submit/enable"
+
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig) {
+    (void)sig;
+    stop = 1;
+}
+
+
+/************************************************************************************
+* Tracefs access
+************************************************************************************/
+
+// Write a string to a file below the tracefs mount point
+static int tracefs_write(const char *tracefs, const char *name, const char *val) {
+    char path[512];
+    FILE *f;
+    int ret = 0;
+
+    snprintf(path, sizeof(path), "%s/%s", tracefs, name);
+    f = fopen(path, "w");
+    if (!f) {
+        fprintf(stderr, "Cannot open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    if (fputs(val, f) < 0)
+        ret = -1;
+    if (fclose(f))
+        ret = -1;
+    return ret;
+}
+
+// Look up the name of a process, which is only possible while it is running
+static void get_comm(int pid, char *comm, size_t len) {
+    char path[64];
+    FILE *f;
+
+    snprintf(path, sizeof(path), "/proc/%d/comm", pid);
+    comm[0] = '\0';
+    f = fopen(path, "r");
+    if (!f)
+        return;
+    if (fgets(comm, len, f))
+        comm[strcspn(comm, "\n")] = '\0';
+    fclose(f);
+}
+
+
+/************************************************************************************
+* Main
+************************************************************************************/
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s -o trace_file [-t tracefs] [-d seconds] [-n records]\n", prog);
+    fprintf(stderr, "  -o  binary trace to write\n");
+    fprintf(stderr, "  -t  mount point of tracefs (default %s)\n", DEF_TRACEFS);
+    fprintf(stderr, "  -d  stop after this many seconds, 0 records until interrupted (default 0)\n");
+    fprintf(stderr, "  -n  stop after this many records, 0 for no limit (default 0)\n");
+    fprintf(stderr, "Transfers submitted through ioctl() and io_uring are both recorded.\n");
+}
+
+int main(int argc, char *argv[]) {
+    static struct dma_trace_stream streams[DMA_TRACE_MAX_STREAMS];
+    struct dma_trace_hdr hdr = {.magic = DMA_TRACE_MAGIC, .version = DMA_TRACE_VERSION};
+    struct dma_trace_rec rec;
+    struct sigaction sa;
+    const char *tracefs = DEF_TRACEFS, *out = NULL, *ev;
+    unsigned long long ts, first_ts = 0;
+    unsigned int handle, op, key;
+    unsigned long size;
+    long duration = 0, max_recs = 0;
+    int pid, slot, i, opt, ret = 0;
+    char path[512], line[512];
+    FILE *pipe, *trace;
+
+    while ((opt = getopt(argc, argv, "o:t:d:n:h")) != -1) {
+        switch (opt) {
+        case 'o': out = optarg; break;
+        case 't': tracefs = optarg; break;
+        case 'd': duration = strtol(optarg, NULL, 0); break;
+        case 'n': max_recs = strtol(optarg, NULL, 0); break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (!out) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    trace = fopen(out, "wb");
+    if (!trace) {
+        fprintf(stderr, "Cannot create %s: %s\n", out, strerror(errno));
+        return 1;
+    }
+
+    // The header is rewritten with the final counts once recording stops
+    if (fwrite(&hdr, sizeof(hdr), 1, trace) != 1)
+        goto err_close;
+
+    snprintf(path, sizeof(path), "%s/trace_pipe", tracefs);
+    pipe = fopen(path, "r");
+    if (!pipe) {
+        fprintf(stderr, "Cannot open %s: %s\n", path, strerror(errno));
+        goto err_close;
+    }
+    if (tracefs_write(tracefs, SUBMIT_EVENT, "1"))
+        goto err_pipe;
+
+    // Interrupt the blocking read of trace_pipe on SIGINT, SIGTERM or when the duration is over
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGALRM, &sa, NULL);
+    if (duration > 0)
+        alarm(duration);
+
+    fprintf(stderr, "Recording dma_proxy submissions to %s\n", out);
+    while (!stop && (!max_recs || hdr.num_recs < max_recs) && fgets(line, sizeof(line), pipe)) {
+        ev = strstr(line, "dma_proxy_submit: ");
+        if (!ev || sscanf(ev, "dma_proxy_submit: ts=%llu pid=%d slot=%d handle=%u size=%lu op=%u key=%u",
+                          &ts, &pid, &slot, &handle, &size, &op, &key) != 7)
+            continue;
+
+        // Each file descriptor of each process is a stream of its own
+        for (i = 0; i < hdr.num_streams; i++) {
+            if (streams[i].pid == pid && streams[i].slot == slot)
+                break;
+        }
+        if (i == hdr.num_streams) {
+            if (i == DMA_TRACE_MAX_STREAMS) {
+                fprintf(stderr, "Too many streams, dropping the transfers of pid %d\n", pid);
+                continue;
+            }
+            streams[i].pid = pid;
+            streams[i].slot = slot;
+            get_comm(pid, streams[i].comm, sizeof(streams[i].comm));
+            hdr.num_streams++;
+        }
+
+        // Events of different CPUs may arrive slightly out of order
+        if (!hdr.num_recs)
+            first_ts = ts;
+        rec.ts_ns = ts > first_ts ? ts - first_ts : 0;
+        rec.size = size;
+        rec.stream = i;
+        rec.key = key;
+        rec.op = op;
+        memset(rec.rsvd, 0, sizeof(rec.rsvd));
+        if (fwrite(&rec, sizeof(rec), 1, trace) != 1) {
+            ret = 1;
+            break;
+        }
+        hdr.num_recs++;
+    }
+
+    tracefs_write(tracefs, SUBMIT_EVENT, "0");
+    fclose(pipe);
+
+    if (fwrite(streams, sizeof(streams[0]), hdr.num_streams, trace) != hdr.num_streams
+        || fseek(trace, 0, SEEK_SET) || fwrite(&hdr, sizeof(hdr), 1, trace) != 1)
+        ret = 1;
+    if (fclose(trace) || ret) {
+        fprintf(stderr, "Cannot write %s\n", out);
+        return 1;
+    }
+    fprintf(stderr, "Recorded %u transfers of %u streams\n", hdr.num_recs, hdr.num_streams);
+    return 0;
+
+err_pipe:
+    fclose(pipe);
+err_close:
+    fclose(trace);
+    return 1;
+}
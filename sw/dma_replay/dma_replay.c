@@ -0,0 +1,269 @@
+#include <errno.h>      // errno
+#include <fcntl.h>      // open
+#include <pthread.h>    // One thread per stream
+#include <stdio.h>      // printf
+#include <stdlib.h>     // malloc/qsort
+#include <string.h>     // strerror
+#include <time.h>       // clock_nanosleep
+#include <unistd.h>     // getopt/close
+#include <sys/ioctl.h>  // ioctl
+#include <sys/mman.h>   // mmap/munmap
+#include "dma_trace.h"
+
+#define DEF_DEVICE      "/dev/dma_proxy"
+
+// Replay state of a single stream
+struct stream {
+    int             index;
+    const char      *device;    // Device file the stream replays against
+    uint32_t        *recs;      // Indices of the records of this stream, in submission order
+    uint32_t        num_recs;
+    uint32_t        max_size;   // Largest transfer of the stream
+    uint64_t        *lat_ns;    // Latency of each replayed transfer
+    uint64_t        bytes;
+    uint64_t        max_lag_ns; // Worst delay of a submission against its schedule
+    uint32_t        errors;
+    pthread_t       thread;
+};
+
+static struct dma_trace_hdr hdr;
+static struct dma_trace_rec *recs;
+static struct dma_trace_stream *trace_streams;
+static double speed = 1;
+static struct timespec t0;
+
+
+/************************************************************************************
+* Helpers
+************************************************************************************/
+
+static uint64_t ts_ns(const struct timespec *ts) {
+    return ts->tv_sec * 1000000000ULL + ts->tv_nsec;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts_ns(&ts);
+}
+
+// Sleep until the given time on CLOCK_MONOTONIC
+static void sleep_until(uint64_t ns) {
+    struct timespec ts = {.tv_sec = ns / 1000000000ULL, .tv_nsec = ns % 1000000000ULL};
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+        ;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+
+/************************************************************************************
+* Replay
+************************************************************************************/
+
+// Issue the transfers of one stream at their recorded times, scaled by the speed factor
+static void *replay_stream(void *arg) {
+    struct stream *s = (struct stream *)arg;
+    struct dma_proxy_buf_req req = {.size = s->max_size};
+    struct dma_proxy_xfer_op xfer;
+    const struct dma_trace_rec *rec;
+    void *buf;
+    uint64_t start, target;
+    uint32_t i;
+    int fd = open(s->device, O_RDWR);
+
+    if (fd < 0 || ioctl(fd, DMAPROXY_IOCTBUFNEW, &req)) {
+        fprintf(stderr, "Stream %d: cannot set up a %u byte buffer: %s\n", s->index, s->max_size,
+                strerror(errno));
+        s->errors = s->num_recs;
+        if (fd >= 0)
+            close(fd);
+        return NULL;
+    }
+    buf = mmap(NULL, req.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, req.offset);
+    if (buf == MAP_FAILED) {
+        s->errors = s->num_recs;
+        close(fd);
+        return NULL;
+    }
+    memset(buf, 0x5A, s->max_size);
+    sleep_until(ts_ns(&t0));
+
+    for (i = 0; i < s->num_recs; i++) {
+        rec = &recs[s->recs[i]];
+
+        // A speed of zero issues every transfer as soon as the previous one of the stream is done
+        if (speed > 0) {
+            target = ts_ns(&t0) + (uint64_t)(rec->ts_ns / speed);
+            sleep_until(target);
+        } else
+            target = now_ns();
+
+        start = now_ns();
+        if (start - target > s->max_lag_ns)
+            s->max_lag_ns = start - target;
+
+        xfer.handle = req.handle;
+        xfer.len = rec->size;
+        xfer.op = rec->op;
+        xfer.key = rec->key;
+        if (ioctl(fd, DMAPROXY_IOCTXFEROP, &xfer) || ioctl(fd, DMAPROXY_IOCTRXSYNC))
+            s->errors++;
+
+        s->lat_ns[i] = now_ns() - start;
+        s->bytes += rec->size;
+    }
+
+    munmap(buf, req.size);
+    close(fd);
+    return NULL;
+}
+
+// Print the results of a stream, the latencies are sorted in place
+static void report(const char *name, uint64_t *lat_ns, uint32_t n, uint64_t bytes, uint32_t errors,
+                   uint64_t max_lag_ns, double elapsed) {
+    qsort(lat_ns, n, sizeof(*lat_ns), cmp_u64);
+    printf("%-24s %8u %8u %10.2f %10.1f %10.1f %10.1f %10.1f\n", name, n, errors, bytes / elapsed / 1e6,
+           n ? lat_ns[n / 2] / 1e3 : 0, n ? lat_ns[n * 9 / 10] / 1e3 : 0, n ? lat_ns[n * 99 / 100] / 1e3 : 0,
+           max_lag_ns / 1e3);
+}
+
+
+/************************************************************************************
+* Main
+************************************************************************************/
+
+// Read a trace written by dma_record
+static int load_trace(const char *path) {
+    FILE *f = fopen(path, "rb");
+    int ret = -1;
+
+    if (!f) {
+        fprintf(stderr, "Cannot open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    if (fread(&hdr, sizeof(hdr), 1, f) != 1 || hdr.magic != DMA_TRACE_MAGIC || hdr.version != DMA_TRACE_VERSION
+        || hdr.num_streams > DMA_TRACE_MAX_STREAMS) {
+        fprintf(stderr, "%s is not a dma_proxy trace\n", path);
+        goto out;
+    }
+
+    recs = calloc(hdr.num_recs ? hdr.num_recs : 1, sizeof(*recs));
+    trace_streams = calloc(hdr.num_streams ? hdr.num_streams : 1, sizeof(*trace_streams));
+    if (!recs || !trace_streams || fread(recs, sizeof(*recs), hdr.num_recs, f) != hdr.num_recs
+        || fread(trace_streams, sizeof(*trace_streams), hdr.num_streams, f) != hdr.num_streams) {
+        fprintf(stderr, "%s is truncated\n", path);
+        goto out;
+    }
+    ret = 0;
+
+out:
+    fclose(f);
+    return ret;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s -i trace_file [-D device] [-s speed]\n", prog);
+    fprintf(stderr, "  -i  binary trace written by dma_record\n");
+    fprintf(stderr, "  -D  device file to replay against, e.g. of a driver bound to the software model\n");
+    fprintf(stderr, "      (default %s)\n", DEF_DEVICE);
+    fprintf(stderr, "  -s  speed factor, 2 replays twice as fast, 0 as fast as possible (default 1)\n");
+    fprintf(stderr, "Transfers recorded from io_uring are replayed through ioctl().\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *in = NULL, *device = DEF_DEVICE;
+    struct stream *streams;
+    struct stream *s;
+    uint64_t *all_lat, bytes = 0, max_lag_ns = 0, end;
+    uint32_t i, n = 0, errors = 0;
+    double elapsed, recorded;
+    char name[64];
+    int opt;
+
+    while ((opt = getopt(argc, argv, "i:D:s:h")) != -1) {
+        switch (opt) {
+        case 'i': in = optarg; break;
+        case 'D': device = optarg; break;
+        case 's': speed = strtod(optarg, NULL); break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (!in || speed < 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (load_trace(in) || !hdr.num_recs)
+        return 1;
+
+    // Split the records into streams
+    streams = calloc(hdr.num_streams, sizeof(*streams));
+    all_lat = calloc(hdr.num_recs, sizeof(*all_lat));
+    if (!streams || !all_lat)
+        return 1;
+    for (i = 0; i < hdr.num_recs; i++) {
+        if (recs[i].stream >= hdr.num_streams || recs[i].op >= DMAPROXY_NUM_OPS) {
+            fprintf(stderr, "Invalid record %u\n", i);
+            return 1;
+        }
+        streams[recs[i].stream].num_recs++;
+    }
+    for (i = 0; i < hdr.num_streams; i++) {
+        s = &streams[i];
+        s->index = i;
+        s->device = device;
+        s->recs = calloc(s->num_recs ? s->num_recs : 1, sizeof(*s->recs));
+        s->lat_ns = calloc(s->num_recs ? s->num_recs : 1, sizeof(*s->lat_ns));
+        if (!s->recs || !s->lat_ns)
+            return 1;
+        s->num_recs = 0;
+    }
+    for (i = 0; i < hdr.num_recs; i++) {
+        s = &streams[recs[i].stream];
+        s->recs[s->num_recs++] = i;
+        if (recs[i].size > s->max_size)
+            s->max_size = recs[i].size;
+    }
+
+    // Leave the streams some time to set up their buffers before the first transfer
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    t0.tv_sec += 1;
+    for (i = 0; i < hdr.num_streams; i++) {
+        if (pthread_create(&streams[i].thread, NULL, replay_stream, &streams[i])) {
+            fprintf(stderr, "Cannot start stream %u\n", i);
+            return 1;
+        }
+    }
+    for (i = 0; i < hdr.num_streams; i++)
+        pthread_join(streams[i].thread, NULL);
+    end = now_ns();
+
+    elapsed = (end - ts_ns(&t0)) / 1e9;
+    recorded = recs[hdr.num_recs - 1].ts_ns / 1e9;
+    printf("Replayed %u transfers of %u streams %s in %.3fs, recorded in %.3fs\n\n", hdr.num_recs,
+           hdr.num_streams, device, elapsed, recorded);
+    printf("%-24s %8s %8s %10s %10s %10s %10s %10s\n", "STREAM", "XFERS", "ERRORS", "MB/s", "p50 us", "p90 us",
+           "p99 us", "max lag us");
+    for (i = 0; i < hdr.num_streams; i++) {
+        s = &streams[i];
+        snprintf(name, sizeof(name), "%d/%d %.16s", trace_streams[i].pid, trace_streams[i].slot,
+                 trace_streams[i].comm);
+        memcpy(all_lat + n, s->lat_ns, s->num_recs * sizeof(*all_lat));
+        n += s->num_recs;
+        bytes += s->bytes;
+        errors += s->errors;
+        if (s->max_lag_ns > max_lag_ns)
+            max_lag_ns = s->max_lag_ns;
+        report(name, s->lat_ns, s->num_recs, s->bytes, s->errors, s->max_lag_ns, elapsed);
+    }
+    report("total", all_lat, n, bytes, errors, max_lag_ns, elapsed);
+    return errors ? 1 : 0;
+}
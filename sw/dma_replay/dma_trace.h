@@ -0,0 +1,70 @@
+#ifndef __DMA_TRACE_H_
+#define __DMA_TRACE_H_
+
+#include <stdint.h>     // uintX_t
+#include <sys/ioctl.h>  // _IOWR and friends
+
+/************************************************************************************
+* Driver interface (see sw/driver/dma_proxy_driver.h)
+************************************************************************************/
+#define DMAPROXY_IOCTMAGIC      0x89
+#define DMAPROXY_IOCTRXSYNC     _IO(DMAPROXY_IOCTMAGIC, 4)
+#define DMAPROXY_IOCTBUFNEW     _IOWR(DMAPROXY_IOCTMAGIC, 7, struct dma_proxy_buf_req)
+#define DMAPROXY_IOCTXFEROP     _IOW(DMAPROXY_IOCTMAGIC, 13, struct dma_proxy_xfer_op)
+
+#define DMAPROXY_OP_INVERT      0
+#define DMAPROXY_OP_BSWAP       1
+#define DMAPROXY_OP_XOR         2
+#define DMAPROXY_OP_CSUM        3
+#define DMAPROXY_NUM_OPS        4
+
+struct dma_proxy_buf_req {
+    unsigned long long size;
+    unsigned long long offset;
+    unsigned int handle;
+    unsigned int rsvd;
+};
+
+struct dma_proxy_xfer_op {
+    unsigned int handle;
+    unsigned int len;
+    unsigned int op;
+    unsigned int key;
+};
+
+
+/************************************************************************************
+* Binary workload trace, written by dma_record and read by dma_replay
+*
+* The file is a header, num_recs records in submission order, then num_streams stream
+* descriptions. A stream is one file descriptor of one process, and the replayer
+* gives each stream its own file descriptor again. Fields are stored in host byte order.
+************************************************************************************/
+#define DMA_TRACE_MAGIC         0x52545044  // "DPTR"
+#define DMA_TRACE_VERSION       2
+#define DMA_TRACE_MAX_STREAMS   256
+
+struct dma_trace_hdr {
+    uint32_t    magic;          // DMA_TRACE_MAGIC
+    uint16_t    version;        // DMA_TRACE_VERSION
+    uint16_t    num_streams;    // Number of stream descriptions after the records
+    uint32_t    num_recs;       // Number of records after the header
+    uint32_t    rsvd;
+};
+
+struct dma_trace_rec {
+    uint64_t    ts_ns;          // Submission time, relative to the first record
+    uint32_t    size;           // Number of bytes transferred
+    uint32_t    key;            // Key of the transform
+    uint16_t    stream;         // Index of the stream that submitted the transfer
+    uint8_t     op;             // Transform, one of DMAPROXY_OP_*
+    uint8_t     rsvd[5];
+};
+
+struct dma_trace_stream {
+    int32_t     pid;            // Process that submitted the transfers
+    int32_t     slot;           // Slot of its file descriptor in the driver
+    char        comm[16];       // Name of the process at the time of recording, if it was known
+};
+
+#endif  // __DMA_TRACE_H_
@@ -0,0 +1,290 @@
+#include <errno.h>      // errno
+#include <stdio.h>      // printf
+#include <stdlib.h>     // strtol
+#include <string.h>     // strerror
+#include <time.h>       // clock_gettime/nanosleep
+#include <unistd.h>     // getopt
+
+#define DEF_STATS_DIR   "/sys/class/dmaprx/dma_proxy/stats"
+#define LAT_BUCKETS     24      // Must match DMA_PROXY_LAT_BUCKETS in the driver
+#define MAX_CLIENTS     64      // Upper bound, the driver allows MAX_INST open file descriptors
+#define COMM_LEN        16
+
+struct counters {
+    long long xfers;
+    long long bytes;
+    long long errors;
+    long long wait_ns;
+    long long busy_ns;
+};
+
+struct client {
+    int             slot;
+    int             pid;
+    char            comm[COMM_LEN + 1];
+    struct counters cnt;
+};
+
+struct sample {
+    double          time;                   // Monotonic time of the sample, in seconds
+    struct counters cnt;
+    long long       hist[LAT_BUCKETS];
+    int             queue_depth;
+    int             num_clients;
+    struct client   clients[MAX_CLIENTS];
+};
+
+
+/************************************************************************************
+* Reading the statistics
+************************************************************************************/
+
+// Open one attribute of the statistics directory
+static FILE *open_attr(const char *dir, const char *name) {
+    char path[512];
+    FILE *f;
+
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    f = fopen(path, "r");
+    if (!f)
+        fprintf(stderr, "Cannot open %s: %s\n", path, strerror(errno));
+    return f;
+}
+
+// Read an attribute holding a single counter
+static int read_counter(const char *dir, const char *name, long long *val) {
+    FILE *f = open_attr(dir, name);
+    int ret = 0;
+
+    if (!f)
+        return -1;
+    if (fscanf(f, "%lld", val) != 1)
+        ret = -1;
+    fclose(f);
+    return ret;
+}
+
+// Take a sample of all the statistics of the device
+static int read_sample(const char *dir, struct sample *s) {
+    struct timespec ts;
+    struct client *c;
+    long long depth;
+    FILE *f;
+    int i;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    s->time = ts.tv_sec + ts.tv_nsec / 1e9;
+
+    if (read_counter(dir, "xfers", &s->cnt.xfers) || read_counter(dir, "bytes", &s->cnt.bytes)
+        || read_counter(dir, "errors", &s->cnt.errors) || read_counter(dir, "wait_ns", &s->cnt.wait_ns)
+        || read_counter(dir, "busy_ns", &s->cnt.busy_ns) || read_counter(dir, "queue_depth", &depth))
+        return -1;
+    s->queue_depth = depth;
+
+    f = open_attr(dir, "latency_hist");
+    if (!f)
+        return -1;
+    for (i = 0; i < LAT_BUCKETS; i++) {
+        if (fscanf(f, "%lld", &s->hist[i]) != 1) {
+            fclose(f);
+            return -1;
+        }
+    }
+    fclose(f);
+
+    f = open_attr(dir, "clients");
+    if (!f)
+        return -1;
+    for (s->num_clients = 0; s->num_clients < MAX_CLIENTS; s->num_clients++) {
+        c = &s->clients[s->num_clients];
+        // The command name is last and may contain spaces
+        if (fscanf(f, "%d %d %lld %lld %lld %lld %lld %16[^\n]", &c->slot, &c->pid, &c->cnt.xfers, &c->cnt.bytes,
+                   &c->cnt.errors, &c->cnt.wait_ns, &c->cnt.busy_ns, c->comm) != 8)
+            break;
+    }
+    fclose(f);
+    return 0;
+}
+
+
+/************************************************************************************
+* Rates and percentiles
+************************************************************************************/
+
+// Find the previous sample of the client in the same slot, if it's still the same process
+static const struct client *find_client(const struct sample *s, const struct client *c) {
+    int i;
+
+    for (i = 0; i < s->num_clients; i++) {
+        if (s->clients[i].slot == c->slot && s->clients[i].pid == c->pid)
+            return &s->clients[i];
+    }
+    return NULL;
+}
+
+// Upper bound in us of the bucket holding the requested fraction of the latencies in the interval,
+// bucket 0 is below 1 us and bucket i covers [2^(i-1), 2^i) us
+static long long percentile(const struct sample *prev, const struct sample *cur, double frac) {
+    long long total = 0, seen = 0;
+    int i;
+
+    for (i = 0; i < LAT_BUCKETS; i++)
+        total += cur->hist[i] - prev->hist[i];
+    if (!total)
+        return 0;
+
+    for (i = 0; i < LAT_BUCKETS; i++) {
+        seen += cur->hist[i] - prev->hist[i];
+        if (seen >= frac * total)
+            break;
+    }
+    return 1LL << (i < LAT_BUCKETS ? i : LAT_BUCKETS - 1);
+}
+
+struct rates {
+    double mbps;
+    double xfers;
+    double errors;
+    double wait_us;     // Average wait for the hardware per transfer
+    double util;        // Fraction of the interval the hardware was busy
+};
+
+// Compute the rates of a set of counters over an interval
+static void get_rates(const struct counters *prev, const struct counters *cur, double dt, struct rates *r) {
+    long long xfers = cur->xfers - prev->xfers;
+
+    r->mbps = (cur->bytes - prev->bytes) / dt / 1e6;
+    r->xfers = xfers / dt;
+    r->errors = (cur->errors - prev->errors) / dt;
+    r->wait_us = xfers ? (cur->wait_ns - prev->wait_ns) / 1e3 / xfers : 0;
+    r->util = (cur->busy_ns - prev->busy_ns) / (dt * 1e9);
+}
+
+
+/************************************************************************************
+* Output
+************************************************************************************/
+
+// Full screen view, refreshed after each interval
+static void show_screen(const char *dir, const struct sample *prev, const struct sample *cur) {
+    static const struct counters zero;
+    double dt = cur->time - prev->time;
+    const struct client *c, *pc;
+    struct rates r;
+    int i;
+
+    get_rates(&prev->cnt, &cur->cnt, dt, &r);
+
+    printf("\033[H\033[2J");
+    printf("dmaproxy-top - %s - every %.1fs\n\n", dir, dt);
+    printf("%10s %10s %8s %6s %10s %6s %8s %8s %8s\n", "MB/s", "xfers/s", "errs/s", "queue", "wait us",
+           "util", "p50 us", "p90 us", "p99 us");
+    printf("%10.2f %10.1f %8.1f %6d %10.1f %5.0f%% %8lld %8lld %8lld\n\n", r.mbps, r.xfers, r.errors,
+           cur->queue_depth, r.wait_us, r.util * 100, percentile(prev, cur, 0.5), percentile(prev, cur, 0.9),
+           percentile(prev, cur, 0.99));
+
+    printf("%4s %8s %-16s %10s %10s %8s %10s %6s\n", "SLOT", "PID", "COMM", "MB/s", "xfers/s", "errs/s",
+           "wait us", "util");
+    for (i = 0; i < cur->num_clients; i++) {
+        c = &cur->clients[i];
+        pc = find_client(prev, c);
+        get_rates(pc ? &pc->cnt : &zero, &c->cnt, dt, &r);
+        printf("%4d %8d %-16s %10.2f %10.1f %8.1f %10.1f %5.0f%%\n", c->slot, c->pid, c->comm, r.mbps, r.xfers,
+               r.errors, r.wait_us, r.util * 100);
+    }
+    fflush(stdout);
+}
+
+// Print a string as the contents of a JSON string
+static void print_json_str(const char *str) {
+    for (; *str; str++) {
+        if (*str == '"' || *str == '\\')
+            printf("\\%c", *str);
+        else if ((unsigned char)*str < 0x20)
+            printf("\\u%04x", (unsigned char)*str);
+        else
+            putchar(*str);
+    }
+}
+
+// Single JSON object, for scripts
+static void show_json(const struct sample *prev, const struct sample *cur) {
+    static const struct counters zero;
+    double dt = cur->time - prev->time;
+    const struct client *c, *pc;
+    struct rates r;
+    int i;
+
+    get_rates(&prev->cnt, &cur->cnt, dt, &r);
+    printf("{\"interval\": %.3f, \"mbps\": %.3f, \"xfers_per_s\": %.3f, \"errors_per_s\": %.3f, "
+           "\"queue_depth\": %d, \"wait_us\": %.3f, \"util\": %.3f, \"p50_us\": %lld, \"p90_us\": %lld, "
+           "\"p99_us\": %lld, \"clients\": [", dt, r.mbps, r.xfers, r.errors, cur->queue_depth, r.wait_us, r.util,
+           percentile(prev, cur, 0.5), percentile(prev, cur, 0.9), percentile(prev, cur, 0.99));
+    for (i = 0; i < cur->num_clients; i++) {
+        c = &cur->clients[i];
+        pc = find_client(prev, c);
+        get_rates(pc ? &pc->cnt : &zero, &c->cnt, dt, &r);
+        printf("%s{\"slot\": %d, \"pid\": %d, \"comm\": \"", i ? ", " : "", c->slot, c->pid);
+        print_json_str(c->comm);
+        printf("\", \"mbps\": %.3f, \"xfers_per_s\": %.3f, \"errors_per_s\": %.3f, \"wait_us\": %.3f, "
+               "\"util\": %.3f}", r.mbps, r.xfers, r.errors, r.wait_us, r.util);
+    }
+    printf("]}\n");
+}
+
+
+/************************************************************************************
+* Main
+************************************************************************************/
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-s stats_dir] [-d seconds] [-n iterations] [-j]\n", prog);
+    fprintf(stderr, "  -s  statistics directory of the device (default %s)\n", DEF_STATS_DIR);
+    fprintf(stderr, "  -d  refresh interval (default 1)\n");
+    fprintf(stderr, "  -n  number of refreshes, 0 runs until interrupted (default 0)\n");
+    fprintf(stderr, "  -j  print a single JSON sample and exit\n");
+}
+
+int main(int argc, char *argv[]) {
+    static struct sample samples[2];
+    const char *dir = DEF_STATS_DIR;
+    double delay = 1;
+    struct timespec ts;
+    long iters = 0, i;
+    int json = 0, opt, cur = 0;
+
+    while ((opt = getopt(argc, argv, "s:d:n:jh")) != -1) {
+        switch (opt) {
+        case 's': dir = optarg; break;
+        case 'd': delay = strtod(optarg, NULL); break;
+        case 'n': iters = strtol(optarg, NULL, 0); break;
+        case 'j': json = 1; break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (delay <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (json)
+        iters = 1;
+
+    ts.tv_sec = (time_t)delay;
+    ts.tv_nsec = (long)((delay - ts.tv_sec) * 1e9);
+
+    if (read_sample(dir, &samples[cur]))
+        return 1;
+    for (i = 0; !iters || i < iters; i++) {
+        nanosleep(&ts, NULL);
+        cur ^= 1;
+        if (read_sample(dir, &samples[cur]))
+            return 1;
+        if (json)
+            show_json(&samples[cur ^ 1], &samples[cur]);
+        else
+            show_screen(dir, &samples[cur ^ 1], &samples[cur]);
+    }
+    return 0;
+}
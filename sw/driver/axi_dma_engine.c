@@ -0,0 +1,182 @@
+#include <linux/errno.h>        // Linux error codes
+#include <linux/module.h>       // Module macros
+#include <linux/scatterlist.h>  // Scatter-gather tables for slave transfers
+#include "axi_dma_engine.h"
+
+/**
+ * axi_dma_engine_request - Request the MM2S and S2MM channels
+ *
+ * @dev: The client device whose device tree node lists the channels
+ * @tx_chan: Returns the MM2S channel
+ * @rx_chan: Returns the S2MM channel
+ *
+ * This function looks up the channels named AXI_DMA_ENGINE_TX_NAME and
+ * AXI_DMA_ENGINE_RX_NAME in the "dma-names" property of the client node.
+ * Note that -EPROBE_DEFER is returned as long as the provider driver
+ * has not been probed yet.
+ *
+ * This function return zero in case of success, and an error code otherwise.
+ */
+int axi_dma_engine_request(struct device *dev, struct dma_chan **tx_chan, struct dma_chan **rx_chan) {
+    if (!dev || !tx_chan || !rx_chan)
+        return -EINVAL;
+
+    *tx_chan = dma_request_chan(dev, AXI_DMA_ENGINE_TX_NAME);
+    if (IS_ERR(*tx_chan))
+        return PTR_ERR(*tx_chan);
+
+    *rx_chan = dma_request_chan(dev, AXI_DMA_ENGINE_RX_NAME);
+    if (IS_ERR(*rx_chan)) {
+        dma_release_channel(*tx_chan);
+        return PTR_ERR(*rx_chan);
+    }
+
+    return 0;
+}
+
+/**
+ * axi_dma_engine_release - Release both channels
+ *
+ * @tx_chan: The MM2S channel
+ * @rx_chan: The S2MM channel
+ *
+ * This function aborts anything still queued and hands the channels back to the provider.
+ */
+void axi_dma_engine_release(struct dma_chan *tx_chan, struct dma_chan *rx_chan) {
+    axi_dma_engine_abort(tx_chan, rx_chan);
+    if (tx_chan)
+        dma_release_channel(tx_chan);
+    if (rx_chan)
+        dma_release_channel(rx_chan);
+}
+
+/**
+ * axi_dma_engine_prep - Prepare a single-buffer slave transfer
+ *
+ * @chan: The channel to prepare the transfer for
+ * @buf: DMA address of the buffer, mapped for the provider device
+ * @sz: Number of bytes to transfer
+ * @dir: DMA_MEM_TO_DEV for MM2S, DMA_DEV_TO_MEM for S2MM
+ * @callback: Called with the result once the transfer has finished, from the provider's tasklet
+ * @param: Argument of the callback
+ *
+ * This function only builds the descriptor, nothing is queued on the channel
+ * until it is passed to axi_dma_engine_submit().
+ *
+ * This function returns the descriptor in case of success, and NULL otherwise.
+ */
+struct dma_async_tx_descriptor *axi_dma_engine_prep(struct dma_chan *chan, dma_addr_t buf, size_t sz,
+                                                    enum dma_transfer_direction dir,
+                                                    dma_async_tx_callback_result callback, void *param) {
+    struct scatterlist sg;
+    struct dma_async_tx_descriptor *desc;
+    if (!chan || !buf || !sz || !callback)
+        return NULL;
+
+    // The buffer is already mapped, so the list only needs to carry its bus address
+    sg_init_table(&sg, 1);
+    sg_dma_address(&sg) = buf;
+    sg_dma_len(&sg) = sz;
+
+    desc = dmaengine_prep_slave_sg(chan, &sg, 1, dir, DMA_PREP_INTERRUPT | DMA_CTRL_ACK);
+    if (!desc)
+        return NULL;
+
+    desc->callback_result = callback;
+    desc->callback_param = param;
+    return desc;
+}
+
+/**
+ * axi_dma_engine_result - Translate the result of a transfer into an error code
+ *
+ * @result: The result passed to the callback, may be NULL for providers that do not report one
+ *
+ * This function returns zero if the transfer succeeded, and an error code otherwise.
+ */
+int axi_dma_engine_result(const struct dmaengine_result *result) {
+    if (!result)
+        return 0;
+
+    switch (result->result) {
+        case DMA_TRANS_NOERROR:
+            return 0;
+        case DMA_TRANS_READ_FAILED:
+        case DMA_TRANS_WRITE_FAILED:
+            return -EIO;
+        case DMA_TRANS_ABORTED:
+            return -ECANCELED;
+        default:
+            return -EIO;
+    }
+}
+
+/**
+ * axi_dma_engine_submit - Queue a prepared transfer
+ *
+ * @desc: Descriptor returned by axi_dma_engine_prep()
+ *
+ * This function queues the descriptor on its channel, but does not start it.
+ * Call axi_dma_engine_issue() once all descriptors of a job have been queued.
+ *
+ * This function return zero in case of success, and an error code otherwise.
+ */
+int axi_dma_engine_submit(struct dma_async_tx_descriptor *desc) {
+    if (!desc)
+        return -EINVAL;
+
+    if (dma_submit_error(dmaengine_submit(desc)))
+        return -EIO;
+
+    return 0;
+}
+
+/**
+ * axi_dma_engine_issue - Start all queued transfers
+ *
+ * @tx_chan: The MM2S channel
+ * @rx_chan: The S2MM channel
+ *
+ * The S2MM channel is started first so that it is ready to accept the stream
+ * as soon as MM2S starts pushing data through the peripheral.
+ */
+void axi_dma_engine_issue(struct dma_chan *tx_chan, struct dma_chan *rx_chan) {
+    dma_async_issue_pending(rx_chan);
+    dma_async_issue_pending(tx_chan);
+}
+
+/**
+ * axi_dma_engine_abort - Abort all queued and active transfers
+ *
+ * @tx_chan: The MM2S channel
+ * @rx_chan: The S2MM channel
+ *
+ * This function blocks until the provider has stopped both channels.
+ */
+void axi_dma_engine_abort(struct dma_chan *tx_chan, struct dma_chan *rx_chan) {
+    if (tx_chan)
+        dmaengine_terminate_sync(tx_chan);
+    if (rx_chan)
+        dmaengine_terminate_sync(rx_chan);
+}
+
+/**
+ * axi_dma_engine_drain - Wait for all transfers issued on a channel
+ *
+ * @chan: The channel to drain
+ *
+ * This function busy-waits until the last transfer queued on the channel has
+ * completed. It is meant for the rare cases in which the stream path has to be
+ * reconfigured between jobs, not for waiting on regular transfers.
+ *
+ * This function return zero in case of success, and an error code otherwise.
+ */
+int axi_dma_engine_drain(struct dma_chan *chan) {
+    if (!chan)
+        return -EINVAL;
+
+    if (dma_sync_wait(chan, chan->cookie) != DMA_COMPLETE)
+        return -EIO;
+
+    return 0;
+}
@@ -0,0 +1,32 @@
+#ifndef __AXI_DMA_ENGINE_H_
+#define __AXI_DMA_ENGINE_H_
+
+#include <linux/types.h>        // uintX_t and friends
+#include <linux/device.h>       // struct device
+#include <linux/dmaengine.h>    // dmaengine client API
+
+
+/************************************************************************************
+* dmaengine-related defines
+************************************************************************************/
+
+// Channel names expected in the "dma-names" property of the client node
+#define AXI_DMA_ENGINE_TX_NAME  "tx"
+#define AXI_DMA_ENGINE_RX_NAME  "rx"
+
+
+/************************************************************************************
+* dmaengine client function declarations
+************************************************************************************/
+int axi_dma_engine_request(struct device *dev, struct dma_chan **tx_chan, struct dma_chan **rx_chan);
+void axi_dma_engine_release(struct dma_chan *tx_chan, struct dma_chan *rx_chan);
+struct dma_async_tx_descriptor *axi_dma_engine_prep(struct dma_chan *chan, dma_addr_t buf, size_t sz,
+                                                    enum dma_transfer_direction dir,
+                                                    dma_async_tx_callback_result callback, void *param);
+int axi_dma_engine_result(const struct dmaengine_result *result);
+int axi_dma_engine_submit(struct dma_async_tx_descriptor *desc);
+void axi_dma_engine_issue(struct dma_chan *tx_chan, struct dma_chan *rx_chan);
+void axi_dma_engine_abort(struct dma_chan *tx_chan, struct dma_chan *rx_chan);
+int axi_dma_engine_drain(struct dma_chan *chan);
+
+#endif  // __AXI_DMA_ENGINE_H_
@@ -2,80 +2,154 @@
 #include <linux/module.h>   // Module macros
 #include <linux/kthread.h>  // kernel threads
 #include <linux/slab.h>     // kmalloc and friends
+#include <linux/delay.h>    // udelay
+#include <linux/ktime.h>    // ktime_get_ns
 #include "axi_dma_iface.h"
 #include "types.h"
+#include "compat.h"
+
+/************************************************************************************
+* Simple mode backend
+************************************************************************************/
+
+// Wait for the soft reset started through a control register to finish, the core clears the bit then
+static int wait_reset(struct axi_dma *dma, uint8_t dmacr) {
+    unsigned int i;
+
+    for (i = 0; i < AXI_DMA_RESET_US; i++) {
+        if (!(reg_rd(dma->base_addr, dmacr) & ((uint32_t)1 << AXI_MM2S_DMACR_Reset)))
+            return 0;
+        udelay(1);
+    }
+    return -ETIMEDOUT;
+}
+
+// Completion state of a channel from its status register, see struct axi_dma_ops
+static int chan_done(struct axi_dma *dma, uint8_t dmasr) {
+    uint32_t reg_val = reg_rd(dma->base_addr, dmasr);
+    int err = axi_dma_sr_err(reg_val);
+
+    if (err)
+        return err;
+    return (reg_val & ((uint32_t)1 << AXI_MM2S_DMASR_Idle)) && (reg_val & ((uint32_t)1 << AXI_MM2S_DMASR_IOC_Irq));
+}
 
 /**
- * axi_dma_reset - Reset the DMA core
+ * axi_dma_simple_init - Prepare a core in simple mode
  *
- * @axi_addr: Memory mapped address of the AXI-DMA core
+ * @dma: The core
+ * @dev: Device that DMA memory is allocated for
  *
- * This function resets the RX and TX channels of the core.
+ * Simple mode needs nothing but the registers, which are mapped by the driver.
  *
  * This function return zero in case of success, and an error code otherwise.
  */
-int axi_dma_reset(void *axi_addr) {
-    if (!axi_addr)
-        return -EINVAL;
+int axi_dma_simple_init(struct axi_dma *dma, struct device *dev) {
+    return 0;
+}
+
+/**
+ * axi_dma_simple_release - Undo axi_dma_simple_init()
+ *
+ * @dma: The core
+ * @dev: Device that DMA memory was allocated for
+ */
+void axi_dma_simple_release(struct axi_dma *dma, struct device *dev) {
+}
+
+/**
+ * axi_dma_simple_reset - Reset the DMA core
+ *
+ * @dma: The core
+ *
+ * This function resets the RX and TX channels of the core and waits for the reset
+ * to finish, which also clears the error bits of both status registers.
+ *
+ * This function return zero in case of success, and an error code otherwise.
+ */
+int axi_dma_simple_reset(struct axi_dma *dma) {
+    int err;
 
     // Set the reset bit in MM2S and S2MM control regs and all others to zero
-    reg_wr(((uint32_t)1) << AXI_MM2S_DMACR_Reset, axi_addr, AXI_MM2S_DMACR);
-    reg_wr(((uint32_t)1) << AXI_S2MM_DMACR_Reset, axi_addr, AXI_S2MM_DMACR);
-    return 0;
+    reg_wr(((uint32_t)1) << AXI_MM2S_DMACR_Reset, dma->base_addr, AXI_MM2S_DMACR);
+    reg_wr(((uint32_t)1) << AXI_S2MM_DMACR_Reset, dma->base_addr, AXI_S2MM_DMACR);
+
+    err = wait_reset(dma, AXI_MM2S_DMACR);
+    if (!err)
+        err = wait_reset(dma, AXI_S2MM_DMACR);
+    return err;
 }
 
 /**
- * axi_dma_halt - Halt both channels
+ * axi_dma_simple_halt - Halt both channels
  *
- * @axi_addr: Memory mapped address of the AXI-DMA core
+ * @dma: The core
  *
  * This function halts the RX and TX channels of the core.
  *
  * This function return zero in case of success, and an error code otherwise.
  */
-int axi_dma_halt(void *axi_addr) {
-    if (!axi_addr)
-        return -EINVAL;
-
+int axi_dma_simple_halt(struct axi_dma *dma) {
     // Writing all zeros to the control regs suffices
-    reg_wr(0, axi_addr, AXI_MM2S_DMACR);
-    reg_wr(0, axi_addr, AXI_S2MM_DMACR);
+    reg_wr(0, dma->base_addr, AXI_MM2S_DMACR);
+    reg_wr(0, dma->base_addr, AXI_S2MM_DMACR);
     return 0;
 }
 
 /**
- * axi_dma_setup_tx - Set up MM2S channel for sending data
+ * axi_dma_simple_setup_tx - Set up MM2S channel for sending data
  *
- * @axi_addr: Memory mapped address of the AXI-DMA core
+ * @dma: The core
  * @src: Address of the source data buffer
+ * @virt: Unused
  *
- * This function sets up the DMA core for transfer from the specified
- * memory location to the peripheral.
+ * This function puts the MM2S channel into the run state and sets it up
+ * for transfer from the specified memory location to the peripheral.
  *
  * This function return zero in case of success, and an error code otherwise.
  */
-int axi_dma_setup_tx(void *axi_addr, dma_addr_t src) {
+int axi_dma_simple_setup_tx(struct axi_dma *dma, dma_addr_t src, void *virt) {
     uint32_t reg_val = 0;
-    if (!axi_addr || !src)
-        return -EINVAL;
-
-    // Set the source address
-    reg_wr((uint32_t)src, axi_addr, AXI_MM2S_SA);
 
     // Start channel with masked interrupts
     reg_val |= (((uint32_t)1) << AXI_MM2S_DMACR_RS);
     reg_val |= (((uint32_t)1) << AXI_MM2S_DMACR_IOC_IrqEn);
     reg_val |= (((uint32_t)1) << AXI_MM2S_DMACR_Dly_IrqEn);
     reg_val |= (((uint32_t)1) << AXI_MM2S_DMACR_Err_IrqEn);
-    reg_wr(reg_val, axi_addr, AXI_MM2S_DMACR);
-    
+    reg_wr(reg_val, dma->base_addr, AXI_MM2S_DMACR);
+
+    return axi_dma_simple_load_tx(dma, src, virt);
+}
+
+/**
+ * axi_dma_simple_load_tx - Point an already running MM2S channel at a new source
+ *
+ * @dma: The core
+ * @src: Address of the source data buffer
+ * @virt: Unused
+ *
+ * This function only rewrites the source address and acknowledges the
+ * completion of the previous transfer, DMACR is left untouched.
+ * The upper half of the address is only programmed if the core was
+ * built with more than 32 address bits.
+ *
+ * This function return zero in case of success, and an error code otherwise.
+ */
+int axi_dma_simple_load_tx(struct axi_dma *dma, dma_addr_t src, void *virt) {
+    // Clear the completion flag of the previous transfer (write one to clear)
+    reg_wr(((uint32_t)1) << AXI_MM2S_DMASR_IOC_Irq, dma->base_addr, AXI_MM2S_DMASR);
+
+    // Set the source address
+    reg_wr(lower_32_bits(src), dma->base_addr, AXI_MM2S_SA);
+    if (dma->addr_width > 32)
+        reg_wr(upper_32_bits(src), dma->base_addr, AXI_MM2S_SA_MSB);
     return 0;
 }
 
 /**
- * axi_dma_start_tx - Start a previously set up MM2S transfer
+ * axi_dma_simple_start_tx - Start a previously set up MM2S transfer
  *
- * @axi_addr: Memory mapped address of the AXI-DMA core
+ * @dma: The core
  * @sz: The number of bytes to transmit from the source buffer
  *
  * This function starts a DMA transfer from memory to the peripheral.
@@ -83,69 +157,158 @@ int axi_dma_setup_tx(void *axi_addr, dma_addr_t src) {
  *
  * This function return zero in case of success, and an error code otherwise.
  */
-int axi_dma_start_tx(void *axi_addr, size_t sz) {
+int axi_dma_simple_start_tx(struct axi_dma *dma, size_t sz) {
     // Start the transfer
-    reg_wr((uint32_t)sz, axi_addr, AXI_MM2S_LENGTH);
+    reg_wr((uint32_t)sz, dma->base_addr, AXI_MM2S_LENGTH);
     return 0;
 }
 
 /**
- * axi_dma_setup_rx - Setup S2MM channel for receiving data
+ * axi_dma_simple_setup_rx - Setup S2MM channel for receiving data
  *
- * @axi_addr: Memory mapped address of the AXI-DMA core
+ * @dma: The core
  * @dest: Destination data buffer
+ * @virt: Unused
  * @sz: Number of bytes in the destination buffer
  *
- * This function sets up the S2MM channel for streaming data
- * from the peripheral to the specified location in memory.
+ * This function puts the S2MM channel into the run state and enables it
+ * to stream data from the peripheral to the specified location in memory.
  *
  * This function return zero in case of success, and an error code otherwise.
  */
-int axi_dma_setup_rx(void *axi_addr, dma_addr_t dest, size_t sz) {
+int axi_dma_simple_setup_rx(struct axi_dma *dma, dma_addr_t dest, void *virt, size_t sz) {
     uint32_t reg_val = 0;
-    if (!axi_addr || !dest)
-        return -EINVAL;
-
-    // Set the destinations address
-    reg_wr((uint32_t)dest, axi_addr, AXI_S2MM_DA);
 
-    // Setup channel with masked interrupts and write length to enable channel to receive data
+    // Setup channel with masked interrupts
     reg_val |= (((uint32_t)1) << AXI_S2MM_DMACR_RS);
     reg_val |= (((uint32_t)1) << AXI_S2MM_DMACR_IOC_IRqEn);
     reg_val |= (((uint32_t)1) << AXI_S2MM_DMACR_Dly_IrqEn);
     reg_val |= (((uint32_t)1) << AXI_S2MM_DMACR_Err_IrqEn);
-    reg_wr(reg_val, axi_addr, AXI_S2MM_DMACR);
-    reg_wr((uint32_t)sz, axi_addr, AXI_S2MM_LENGTH);
+    reg_wr(reg_val, dma->base_addr, AXI_S2MM_DMACR);
+
+    return axi_dma_simple_load_rx(dma, dest, virt, sz);
+}
+
+/**
+ * axi_dma_simple_load_rx - Point an already running S2MM channel at a new destination
+ *
+ * @dma: The core
+ * @dest: Destination data buffer
+ * @virt: Unused
+ * @sz: Number of bytes in the destination buffer
+ *
+ * This function only rewrites the destination address and length and
+ * acknowledges the completion of the previous transfer, DMACR is left
+ * untouched. Writing the length enables the channel to receive data.
+ * The upper half of the address is only programmed if the core
+ * was built with more than 32 address bits.
+ *
+ * This function return zero in case of success, and an error code otherwise.
+ */
+int axi_dma_simple_load_rx(struct axi_dma *dma, dma_addr_t dest, void *virt, size_t sz) {
+    // Clear the completion flag of the previous transfer (write one to clear)
+    reg_wr(((uint32_t)1) << AXI_S2MM_DMASR_IOC_Irq, dma->base_addr, AXI_S2MM_DMASR);
+
+    // Set the destinations address and write length to enable channel to receive data
+    reg_wr(lower_32_bits(dest), dma->base_addr, AXI_S2MM_DA);
+    if (dma->addr_width > 32)
+        reg_wr(upper_32_bits(dest), dma->base_addr, AXI_S2MM_DA_MSB);
+    reg_wr((uint32_t)sz, dma->base_addr, AXI_S2MM_LENGTH);
     return 0;
 }
 
 /**
- * axi_dma_sync_tx - Synchronize the MM2S channel
+ * axi_dma_simple_tx_done - Check whether the MM2S transfer has completed
  *
- * @axi_addr: Memory mapped address of the AXI-DMA core
+ * @dma: The core
  *
- * Wait until TX channel is idle. This can be
- * used to check if data has been completely transfered.
+ * The transfer has completed once the channel is idle and has flagged the completion.
  *
- * This function return zero in case of transfer complete, and an error code otherwise.
+ * This function returns a positive value if the transfer has completed, zero while it
+ * is running, and an error code if the channel has reported an error.
  */
-int axi_dma_sync_tx(void *axi_addr) {
-    uint32_t reg_val = 0;
-    if (!axi_addr)
-        return -EINVAL;
+int axi_dma_simple_tx_done(struct axi_dma *dma) {
+    return chan_done(dma, AXI_MM2S_DMASR);
+}
+
+/**
+ * axi_dma_simple_rx_done - Check whether the S2MM transfer has completed
+ *
+ * @dma: The core
+ *
+ * The transfer has completed once the channel is idle and has flagged the completion.
+ *
+ * This function returns a positive value if the transfer has completed, zero while it
+ * is running, and an error code if the channel has reported an error.
+ */
+int axi_dma_simple_rx_done(struct axi_dma *dma) {
+    return chan_done(dma, AXI_S2MM_DMASR);
+}
+
+const struct axi_dma_ops axi_dma_simple_ops = {
+    .name       = "simple",
+    .init       = axi_dma_simple_init,
+    .release    = axi_dma_simple_release,
+    .reset      = axi_dma_simple_reset,
+    .halt       = axi_dma_simple_halt,
+    .setup_tx   = axi_dma_simple_setup_tx,
+    .load_tx    = axi_dma_simple_load_tx,
+    .start_tx   = axi_dma_simple_start_tx,
+    .setup_rx   = axi_dma_simple_setup_rx,
+    .load_rx    = axi_dma_simple_load_rx,
+    .tx_done    = axi_dma_simple_tx_done,
+    .rx_done    = axi_dma_simple_rx_done,
+};
+
+
+/************************************************************************************
+* Synchronization, common to all backends
+************************************************************************************/
 
-    reg_val = reg_rd(axi_addr, AXI_MM2S_DMASR);
-    while (!(reg_val & ((uint32_t)1 << AXI_MM2S_DMASR_Idle)) 
-        || !(reg_val & ((uint32_t)1 << AXI_MM2S_DMASR_IOC_Irq))) {
-        reg_val = reg_rd(axi_addr, AXI_MM2S_DMASR);
+// Poll a channel until its transfer completes, fails, or runs out of dma->timeout_ms
+static int axi_dma_wait(struct axi_dma *dma, bool rx) {
+    u64 deadline = dma->timeout_ms ? ktime_get_ns() + (u64)dma->timeout_ms * NSEC_PER_MSEC : 0;
+    int ret;
+
+    for (;;) {
+        ret = rx ? axi_dma_call(dma, rx_done) : axi_dma_call(dma, tx_done);
+        if (ret)
+            return ret < 0 ? ret : 0;
+        if (deadline && ktime_get_ns() > deadline)
+            return -ETIMEDOUT;
+        cpu_relax();
     }
+}
 
-    return 0;
+/**
+ * axi_dma_sync_tx - Synchronize the MM2S channel
+ *
+ * @dma: The core
+ *
+ * Wait until TX channel is idle. This can be
+ * used to check if data has been completely transfered.
+ *
+ * This function return zero in case of transfer complete, -ETIMEDOUT if it did not complete
+ * within dma->timeout_ms, and the error reported by the channel otherwise.
+ */
+int axi_dma_sync_tx(struct axi_dma *dma) {
+    return axi_dma_wait(dma, false);
 }
 
-// Wait until RX channel is idle, note that this is a kernel thread
-// function that is also in charge of releasing the hardware mutex once
-// the operation is complete
+/**
+ * axi_dma_poll_rx - Wait for the S2MM channel from the calling context
+ *
+ * @dma: The core
+ *
+ * Wait until RX channel is idle. Unlike axi_dma_sync_rx(), this does not
+ * run as a kernel thread and does not release any locks.
+ *
+ * This function return zero in case of transfer complete, -ETIMEDOUT if it did not complete
+ * within dma->timeout_ms, and the error reported by the channel otherwise.
+ */
+int axi_dma_poll_rx(struct axi_dma *dma) {
+    return axi_dma_wait(dma, true);
+}
 
 /**
  * axi_dma_sync_rx - Synchronize the S2MM channel
@@ -153,38 +316,30 @@ int axi_dma_sync_tx(void *axi_addr) {
  * @data: Pointer to a data structure containing information for synchronization
  *
  * Thi function is called as a kernel thread. It waits until the S2MM transfer
- * is complete and until it is stopped.
- * This is currently the case when the initiating process makes an ioctl() call
- * to synchronize its receive buffer.
- * Note that other processes can use the hardware even if this thread has not been
- * stopped, as it releases the hardware mutex once it sees that the S2MM transfer
- * has completed.
- *
- * This function return zero when the thread is stopped, and an error code otherwise.
+ * has completed, failed or timed out, reports the result through the complete
+ * callback and releases the hardware mutex, after which the thread exits.
+ * The initiating process waits for the callback with an ioctl() call to
+ * synchronize its receive buffer.
+ *
+ * This function return zero once the transfer is finished, and an error code otherwise.
  */
 int axi_dma_sync_rx(void *data) {
-    uint32_t reg_val = 0;
     struct rx_sync_dat *sync;
+    int err;
+
     if (!data)
         return -EINVAL;
 
     sync = (struct rx_sync_dat*)data;
-    reg_val = reg_rd(sync->axi_addr, AXI_S2MM_DMASR);
-    while ((!(reg_val & ((uint32_t)1 << AXI_S2MM_DMASR_Idle)) 
-        || !(reg_val & ((uint32_t)1 << AXI_S2MM_DMASR_IOC_Irq)))
-        && !kthread_should_stop()) {
-        reg_val = reg_rd(sync->axi_addr, AXI_S2MM_DMASR);
-    }
+    err = axi_dma_poll_rx(sync->dma);
+
+    // Account for the transfer and recover from errors while the hardware is still held
+    if (sync->complete)
+        sync->complete(sync->job, err);
 
     // Unlock the mutex
     mutex_unlock(sync->hw_lock);
-
-    // Unlock the process-specific mutex to signal that that receiving data has completed
-    mutex_unlock(&sync->instp->rx_lock);
     kzfree(sync);
-
-    // Loop until the thread is stopped
-    while (!kthread_should_stop());
     return 0;
 }
 
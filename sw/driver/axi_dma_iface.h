@@ -3,6 +3,8 @@
 
 #include <linux/types.h>        // uintX_t and friends
 #include <asm/io.h>             // iowrite32 and ioread32
+#include <linux/device.h>       // struct device
+#include <linux/errno.h>        // Linux error codes
 #include "types.h"    
 
 
@@ -20,11 +22,25 @@
 
 // MM2S DMA Status Register
 #define AXI_MM2S_DMASR          0x04
+#define AXI_MM2S_DMASR_Halted   0
 #define AXI_MM2S_DMASR_Idle     1
+#define AXI_MM2S_DMASR_IntErr   4
+#define AXI_MM2S_DMASR_SlvErr   5
+#define AXI_MM2S_DMASR_DecErr   6
+#define AXI_MM2S_DMASR_SGIntErr 8
+#define AXI_MM2S_DMASR_SGSlvErr 9
+#define AXI_MM2S_DMASR_SGDecErr 10
 #define AXI_MM2S_DMASR_IOC_Irq  12
 
-// MM2S Source Address
+// MM2S Current and Tail Descriptor Pointers (SG mode only)
+#define AXI_MM2S_CURDESC        0x08
+#define AXI_MM2S_CURDESC_MSB    0x0C
+#define AXI_MM2S_TAILDESC       0x10
+#define AXI_MM2S_TAILDESC_MSB   0x14
+
+// MM2S Source Address (MSB only present for address widths above 32 bits)
 #define AXI_MM2S_SA     0x18
+#define AXI_MM2S_SA_MSB 0x1C
 
 // MM2S Transfer Length (Bytes)
 #define AXI_MM2S_LENGTH 0x28
@@ -39,20 +55,81 @@
 
 // S2MM DMA Status Register
 #define AXI_S2MM_DMASR          0x34
+#define AXI_S2MM_DMASR_Halted   0
 #define AXI_S2MM_DMASR_Idle     1
+#define AXI_S2MM_DMASR_IntErr   4
+#define AXI_S2MM_DMASR_SlvErr   5
+#define AXI_S2MM_DMASR_DecErr   6
+#define AXI_S2MM_DMASR_SGIntErr 8
+#define AXI_S2MM_DMASR_SGSlvErr 9
+#define AXI_S2MM_DMASR_SGDecErr 10
 #define AXI_S2MM_DMASR_IOC_Irq  12
 
-// S2MM Destination Address
+// S2MM Current and Tail Descriptor Pointers (SG mode only)
+#define AXI_S2MM_CURDESC        0x38
+#define AXI_S2MM_CURDESC_MSB    0x3C
+#define AXI_S2MM_TAILDESC       0x40
+#define AXI_S2MM_TAILDESC_MSB   0x44
+
+// S2MM Destination Address (MSB only present for address widths above 32 bits)
 #define AXI_S2MM_DA     0x48
+#define AXI_S2MM_DA_MSB 0x4C
 
 // S2MM BUffer Length (Bytes)
 #define AXI_S2MM_LENGTH 0x58
 
 
 /************************************************************************************
-* Global variables related to synchronizing the hardware
+* AXI DMA scatter-gather descriptor (see Scatter Gather Descriptor in AXI DMA documentation)
 ************************************************************************************/
-static struct task_struct   *sync_rx_thread = NULL;
+
+// Control word
+#define AXI_BD_CTRL_LEN_MASK    0x03FFFFFF
+#define AXI_BD_CTRL_TXEOF       26
+#define AXI_BD_CTRL_TXSOF       27
+
+// Status word
+#define AXI_BD_STS_IntErr       28
+#define AXI_BD_STS_SlvErr       29
+#define AXI_BD_STS_DecErr       30
+#define AXI_BD_STS_Cmplt        31
+
+// Number of descriptors in the ring of each channel, see axi_dma_sg_load_tx()
+#define AXI_DMA_SG_RING         2
+
+// A descriptor, which the core requires to be aligned to 16 words
+struct axi_dma_bd {
+    __le32  next;           // Address of the next descriptor
+    __le32  next_msb;
+    __le32  buf;            // Address of the buffer
+    __le32  buf_msb;
+    __le32  rsvd[2];
+    __le32  control;        // Length, and start and end of frame for MM2S
+    __le32  status;         // Completion and number of bytes transferred, written by the core
+    __le32  app[5];         // User application fields, unused by this driver
+    __le32  pad[3];
+} __aligned(64);
+
+
+/************************************************************************************
+* Error handling
+************************************************************************************/
+
+// Longest time the core may take to come out of a soft reset, in microseconds
+#define AXI_DMA_RESET_US        1000
+
+// Map the error bits of DMASR to an error code: internal errors (e.g. a length of zero, or
+// a stream that ended early) give -EPROTO, slave errors -EREMOTEIO and decode errors -EFAULT.
+// The bits are at the same positions for both channels.
+static inline int axi_dma_sr_err(uint32_t sr) {
+    if (sr & (((uint32_t)1 << AXI_MM2S_DMASR_IntErr) | ((uint32_t)1 << AXI_MM2S_DMASR_SGIntErr)))
+        return -EPROTO;
+    if (sr & (((uint32_t)1 << AXI_MM2S_DMASR_SlvErr) | ((uint32_t)1 << AXI_MM2S_DMASR_SGSlvErr)))
+        return -EREMOTEIO;
+    if (sr & (((uint32_t)1 << AXI_MM2S_DMASR_DecErr) | ((uint32_t)1 << AXI_MM2S_DMASR_SGDecErr)))
+        return -EFAULT;
+    return 0;
+}
 
 
 /************************************************************************************
@@ -62,29 +139,97 @@ static struct task_struct   *sync_rx_thread = NULL;
 // Write a word to the specified register
 static inline void reg_wr(uint32_t val, void *mm_addr, uint8_t reg_num) 
 {
-    if (mm_addr)
-        iowrite32(val, ((uint8_t *)mm_addr) + reg_num);
+    iowrite32(val, ((uint8_t *)mm_addr) + reg_num);
 }
 
 // Read a word from the specified register
 static inline uint32_t reg_rd(void *mm_addr, uint8_t reg_num)
 {
-    if (mm_addr)
-        return ioread32(((uint8_t *)mm_addr) + reg_num);
-
-    return 0;
+    return ioread32(((uint8_t *)mm_addr) + reg_num);
 }
 
 
+/************************************************************************************
+* Backend operations
+************************************************************************************/
+
+// The ways of driving the core, selected per device at probe time. Both channels move the
+// same buffer, MM2S out of it and S2MM back into it, with virt being its kernel address.
+// tx_done and rx_done return a positive value once the transfer has completed, zero while it
+// is running, and one of the codes of axi_dma_sr_err() if the channel has reported an error.
+struct axi_dma_ops {
+    const char  *name;
+    int         (*init)(struct axi_dma *dma, struct device *dev);
+    void        (*release)(struct axi_dma *dma, struct device *dev);
+    int         (*reset)(struct axi_dma *dma);
+    int         (*halt)(struct axi_dma *dma);
+    int         (*setup_tx)(struct axi_dma *dma, dma_addr_t src, void *virt);
+    int         (*load_tx)(struct axi_dma *dma, dma_addr_t src, void *virt);
+    int         (*start_tx)(struct axi_dma *dma, size_t sz);
+    int         (*setup_rx)(struct axi_dma *dma, dma_addr_t dest, void *virt, size_t sz);
+    int         (*load_rx)(struct axi_dma *dma, dma_addr_t dest, void *virt, size_t sz);
+    int         (*tx_done)(struct axi_dma *dma);
+    int         (*rx_done)(struct axi_dma *dma);
+};
+
+extern const struct axi_dma_ops axi_dma_simple_ops;    // Simple mode registers
+extern const struct axi_dma_ops axi_dma_sg_ops;        // SG mode, one descriptor per transfer
+extern const struct axi_dma_ops axi_dma_model_ops;     // Software model of the core and data_inv
+
+#define __axi_dma_sym(backend, sym)     axi_dma_##backend##_##sym
+#define _axi_dma_sym(backend, sym)      __axi_dma_sym(backend, sym)
+
+// Building with AXI_DMA_BACKEND=<simple|sg|model> binds all calls to that backend at compile
+// time, and devices that need another one are refused at probe time
+#ifdef AXI_DMA_FIXED_BACKEND
+#define axi_dma_fixed_ops               _axi_dma_sym(AXI_DMA_FIXED_BACKEND, ops)
+#define axi_dma_call(dma, fn, ...)      _axi_dma_sym(AXI_DMA_FIXED_BACKEND, fn)(dma, ##__VA_ARGS__)
+#else
+#define axi_dma_call(dma, fn, ...)      (dma)->ops->fn(dma, ##__VA_ARGS__)
+#endif
+
+
 /************************************************************************************
 * AXI DMA interfacing function declarations
 ************************************************************************************/
-int axi_dma_reset(void *axi_addr);
-int axi_dma_halt(void *axi_addr);
-int axi_dma_setup_tx(void *axi_addr, dma_addr_t src);
-int axi_dma_start_tx(void *axi_addr, size_t sz);
-int axi_dma_setup_rx(void *axi_addr, dma_addr_t dest, size_t sz);
-int axi_dma_sync_tx(void *axi_addr);
-int axi_dma_sync_rx(void *axi_addr);
+int axi_dma_simple_init(struct axi_dma *dma, struct device *dev);
+void axi_dma_simple_release(struct axi_dma *dma, struct device *dev);
+int axi_dma_simple_reset(struct axi_dma *dma);
+int axi_dma_simple_halt(struct axi_dma *dma);
+int axi_dma_simple_setup_tx(struct axi_dma *dma, dma_addr_t src, void *virt);
+int axi_dma_simple_load_tx(struct axi_dma *dma, dma_addr_t src, void *virt);
+int axi_dma_simple_start_tx(struct axi_dma *dma, size_t sz);
+int axi_dma_simple_setup_rx(struct axi_dma *dma, dma_addr_t dest, void *virt, size_t sz);
+int axi_dma_simple_load_rx(struct axi_dma *dma, dma_addr_t dest, void *virt, size_t sz);
+int axi_dma_simple_tx_done(struct axi_dma *dma);
+int axi_dma_simple_rx_done(struct axi_dma *dma);
+
+int axi_dma_sg_init(struct axi_dma *dma, struct device *dev);
+void axi_dma_sg_release(struct axi_dma *dma, struct device *dev);
+int axi_dma_sg_reset(struct axi_dma *dma);
+int axi_dma_sg_halt(struct axi_dma *dma);
+int axi_dma_sg_setup_tx(struct axi_dma *dma, dma_addr_t src, void *virt);
+int axi_dma_sg_load_tx(struct axi_dma *dma, dma_addr_t src, void *virt);
+int axi_dma_sg_start_tx(struct axi_dma *dma, size_t sz);
+int axi_dma_sg_setup_rx(struct axi_dma *dma, dma_addr_t dest, void *virt, size_t sz);
+int axi_dma_sg_load_rx(struct axi_dma *dma, dma_addr_t dest, void *virt, size_t sz);
+int axi_dma_sg_tx_done(struct axi_dma *dma);
+int axi_dma_sg_rx_done(struct axi_dma *dma);
+
+int axi_dma_model_init(struct axi_dma *dma, struct device *dev);
+void axi_dma_model_release(struct axi_dma *dma, struct device *dev);
+int axi_dma_model_reset(struct axi_dma *dma);
+int axi_dma_model_halt(struct axi_dma *dma);
+int axi_dma_model_setup_tx(struct axi_dma *dma, dma_addr_t src, void *virt);
+int axi_dma_model_load_tx(struct axi_dma *dma, dma_addr_t src, void *virt);
+int axi_dma_model_start_tx(struct axi_dma *dma, size_t sz);
+int axi_dma_model_setup_rx(struct axi_dma *dma, dma_addr_t dest, void *virt, size_t sz);
+int axi_dma_model_load_rx(struct axi_dma *dma, dma_addr_t dest, void *virt, size_t sz);
+int axi_dma_model_tx_done(struct axi_dma *dma);
+int axi_dma_model_rx_done(struct axi_dma *dma);
+
+int axi_dma_sync_tx(struct axi_dma *dma);
+int axi_dma_sync_rx(void *data);
+int axi_dma_poll_rx(struct axi_dma *dma);
 
 #endif  // __AXI_DMA_IFACE_H_
\ No newline at end of file
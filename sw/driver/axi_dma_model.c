@@ -0,0 +1,185 @@
+#include <linux/errno.h>    // Linux error codes
+#include <linux/string.h>   // memmove
+#include "axi_dma_iface.h"
+#include "axi_xform_iface.h"
+#include "types.h"
+
+/************************************************************************************
+* Software model backend
+*
+* Models the core together with the stream core, without any hardware: starting MM2S
+* transforms the source buffer into the S2MM destination right away, applying the
+* transform the driver selected in xform_op and xform_key like a data_xform core would.
+* This allows the driver, the tools and the tests to run on machines without the FPGA
+* design.
+************************************************************************************/
+
+/**
+ * axi_dma_model_init - Prepare the model
+ *
+ * @dma: The modelled core
+ * @dev: Unused
+ *
+ * This function return zero in case of success, and an error code otherwise.
+ */
+int axi_dma_model_init(struct axi_dma *dma, struct device *dev) {
+    dma->src_virt = NULL;
+    dma->dest_virt = NULL;
+    dma->dest_sz = 0;
+    dma->stalled = false;
+    return 0;
+}
+
+/**
+ * axi_dma_model_release - Undo axi_dma_model_init()
+ *
+ * @dma: The modelled core
+ * @dev: Unused
+ */
+void axi_dma_model_release(struct axi_dma *dma, struct device *dev) {
+}
+
+/**
+ * axi_dma_model_reset - Reset the modelled core
+ *
+ * @dma: The modelled core
+ *
+ * This function return zero in case of success, and an error code otherwise.
+ */
+int axi_dma_model_reset(struct axi_dma *dma) {
+    return axi_dma_model_init(dma, NULL);
+}
+
+/**
+ * axi_dma_model_halt - Halt both modelled channels
+ *
+ * @dma: The modelled core
+ *
+ * This function return zero in case of success, and an error code otherwise.
+ */
+int axi_dma_model_halt(struct axi_dma *dma) {
+    return 0;
+}
+
+/**
+ * axi_dma_model_setup_tx - Set the source of the modelled MM2S channel
+ *
+ * @dma: The modelled core
+ * @src: Unused
+ * @virt: Kernel address of the source data buffer
+ *
+ * This function return zero in case of success, and an error code otherwise.
+ */
+int axi_dma_model_setup_tx(struct axi_dma *dma, dma_addr_t src, void *virt) {
+    dma->src_virt = virt;
+    return 0;
+}
+
+/**
+ * axi_dma_model_load_tx - Set the source of the modelled MM2S channel
+ *
+ * @dma: The modelled core
+ * @src: Unused
+ * @virt: Kernel address of the source data buffer
+ *
+ * This function return zero in case of success, and an error code otherwise.
+ */
+int axi_dma_model_load_tx(struct axi_dma *dma, dma_addr_t src, void *virt) {
+    return axi_dma_model_setup_tx(dma, src, virt);
+}
+
+/**
+ * axi_dma_model_start_tx - Run a modelled transfer
+ *
+ * @dma: The modelled core
+ * @sz: The number of bytes to transmit from the source buffer
+ *
+ * Like the core, S2MM takes at most the size of its destination buffer from the stream.
+ * The selected transform is applied to the data on its way. A stalled transfer moves no
+ * data, as if the stream core had stopped accepting it.
+ *
+ * This function return zero in case of success, and an error code otherwise.
+ */
+int axi_dma_model_start_tx(struct axi_dma *dma, size_t sz) {
+    if (!dma->src_virt || !dma->dest_virt)
+        return -EINVAL;
+    if (dma->stalled)
+        return 0;
+
+    sz = min(sz, dma->dest_sz);
+    memmove(dma->dest_virt, dma->src_virt, sz);
+    axi_xform_model(dma->xform_op, dma->xform_key, dma->dest_virt, sz);
+    return 0;
+}
+
+/**
+ * axi_dma_model_setup_rx - Set the destination of the modelled S2MM channel
+ *
+ * @dma: The modelled core
+ * @dest: Unused
+ * @virt: Kernel address of the destination data buffer
+ * @sz: Number of bytes in the destination buffer
+ *
+ * This function return zero in case of success, and an error code otherwise.
+ */
+int axi_dma_model_setup_rx(struct axi_dma *dma, dma_addr_t dest, void *virt, size_t sz) {
+    dma->dest_virt = virt;
+    dma->dest_sz = sz;
+    return 0;
+}
+
+/**
+ * axi_dma_model_load_rx - Set the destination of the modelled S2MM channel
+ *
+ * @dma: The modelled core
+ * @dest: Unused
+ * @virt: Kernel address of the destination data buffer
+ * @sz: Number of bytes in the destination buffer
+ *
+ * This function return zero in case of success, and an error code otherwise.
+ */
+int axi_dma_model_load_rx(struct axi_dma *dma, dma_addr_t dest, void *virt, size_t sz) {
+    return axi_dma_model_setup_rx(dma, dest, virt, sz);
+}
+
+/**
+ * axi_dma_model_tx_done - Check whether the modelled MM2S transfer has completed
+ *
+ * @dma: The modelled core
+ *
+ * Modelled transfers complete as soon as they are started, and never fail.
+ *
+ * This function returns a positive value, as the transfer has completed.
+ */
+int axi_dma_model_tx_done(struct axi_dma *dma) {
+    return 1;
+}
+
+/**
+ * axi_dma_model_rx_done - Check whether the modelled S2MM transfer has completed
+ *
+ * @dma: The modelled core
+ *
+ * Modelled transfers complete as soon as they are started, and never fail. A stalled
+ * one stays busy until the core is reset.
+ *
+ * This function returns a positive value if the transfer has completed, and zero otherwise.
+ */
+int axi_dma_model_rx_done(struct axi_dma *dma) {
+    return !dma->stalled;
+}
+
+const struct axi_dma_ops axi_dma_model_ops = {
+    .name       = "model",
+    .init       = axi_dma_model_init,
+    .release    = axi_dma_model_release,
+    .reset      = axi_dma_model_reset,
+    .halt       = axi_dma_model_halt,
+    .setup_tx   = axi_dma_model_setup_tx,
+    .load_tx    = axi_dma_model_load_tx,
+    .start_tx   = axi_dma_model_start_tx,
+    .setup_rx   = axi_dma_model_setup_rx,
+    .load_rx    = axi_dma_model_load_rx,
+    .tx_done    = axi_dma_model_tx_done,
+    .rx_done    = axi_dma_model_rx_done,
+};
@@ -0,0 +1,318 @@
+#include <linux/errno.h>        // Linux error codes
+#include <linux/dma-mapping.h>  // dma_alloc_coherent
+#include <linux/delay.h>        // udelay
+#include "axi_dma_iface.h"
+#include "types.h"
+
+/************************************************************************************
+* SG mode backend
+*
+* Each channel has a ring of AXI_DMA_SG_RING descriptors, of which every transfer uses
+* the next one. Once a channel runs, writing the tail pointer to the next descriptor
+* makes the core fetch and process it, so the channel never has to be halted between
+* transfers of a lease.
+************************************************************************************/
+
+// Descriptor of the MM2S ring
+static inline struct axi_dma_bd *tx_bd(struct axi_dma *dma, unsigned int i) {
+    return &dma->bds[i];
+}
+
+// Descriptor of the S2MM ring
+static inline struct axi_dma_bd *rx_bd(struct axi_dma *dma, unsigned int i) {
+    return &dma->bds[AXI_DMA_SG_RING + i];
+}
+
+// Bus address of a descriptor
+static inline dma_addr_t bd_phys(struct axi_dma *dma, struct axi_dma_bd *bd) {
+    return dma->bds_phys + (bd - dma->bds) * sizeof(struct axi_dma_bd);
+}
+
+// Write a descriptor address to a pair of registers, the lower half last as that may start the channel
+static void write_desc(struct axi_dma *dma, dma_addr_t addr, uint8_t reg_lsb, uint8_t reg_msb) {
+    if (dma->addr_width > 32)
+        reg_wr(upper_32_bits(addr), dma->base_addr, reg_msb);
+    reg_wr(lower_32_bits(addr), dma->base_addr, reg_lsb);
+}
+
+// Stop a channel, its current descriptor may only be changed once it has halted
+static int stop_chan(struct axi_dma *dma, uint8_t dmacr, uint8_t dmasr) {
+    unsigned int i;
+
+    reg_wr(0, dma->base_addr, dmacr);
+    for (i = 0; i < AXI_DMA_RESET_US; i++) {
+        if (reg_rd(dma->base_addr, dmasr) & ((uint32_t)1 << AXI_MM2S_DMASR_Halted))
+            return 0;
+        udelay(1);
+    }
+    return -ETIMEDOUT;
+}
+
+// Completion state of the current descriptor of a channel, see struct axi_dma_ops
+static int bd_done(struct axi_dma *dma, struct axi_dma_bd *bd, uint8_t dmasr) {
+    uint32_t status = le32_to_cpu(READ_ONCE(bd->status));
+
+    // Errors of the transfer itself are written back to the descriptor
+    if (status & ((uint32_t)1 << AXI_BD_STS_IntErr))
+        return -EPROTO;
+    if (status & ((uint32_t)1 << AXI_BD_STS_SlvErr))
+        return -EREMOTEIO;
+    if (status & ((uint32_t)1 << AXI_BD_STS_DecErr))
+        return -EFAULT;
+    if (status & ((uint32_t)1 << AXI_BD_STS_Cmplt))
+        return 1;
+
+    // Errors fetching the descriptor halt the channel without touching it
+    return axi_dma_sr_err(reg_rd(dma->base_addr, dmasr));
+}
+
+// Point a descriptor at a buffer
+static void set_buf(struct axi_dma *dma, struct axi_dma_bd *bd, dma_addr_t buf) {
+    bd->buf = cpu_to_le32(lower_32_bits(buf));
+    bd->buf_msb = cpu_to_le32(dma->addr_width > 32 ? upper_32_bits(buf) : 0);
+}
+
+// Hand a descriptor back to the core
+static void arm_bd(struct axi_dma_bd *bd, uint32_t control) {
+    bd->control = cpu_to_le32(control);
+    bd->status = 0;
+
+    // The descriptor must be in memory before the tail pointer makes the core fetch it
+    wmb();
+}
+
+/**
+ * axi_dma_sg_init - Allocate and link the descriptor rings
+ *
+ * @dma: The core
+ * @dev: Device that the rings are allocated for
+ *
+ * This function return zero in case of success, and an error code otherwise.
+ */
+int axi_dma_sg_init(struct axi_dma *dma, struct device *dev) {
+    unsigned int i;
+
+    dma->bds = dma_alloc_coherent(dev, 2 * AXI_DMA_SG_RING * sizeof(struct axi_dma_bd), &dma->bds_phys, GFP_KERNEL);
+    if (!dma->bds)
+        return -ENOMEM;
+    memset(dma->bds, 0, 2 * AXI_DMA_SG_RING * sizeof(struct axi_dma_bd));
+
+    for (i = 0; i < AXI_DMA_SG_RING; i++) {
+        tx_bd(dma, i)->next = cpu_to_le32(lower_32_bits(bd_phys(dma, tx_bd(dma, (i + 1) % AXI_DMA_SG_RING))));
+        tx_bd(dma, i)->next_msb = cpu_to_le32(upper_32_bits(bd_phys(dma, tx_bd(dma, (i + 1) % AXI_DMA_SG_RING))));
+        rx_bd(dma, i)->next = cpu_to_le32(lower_32_bits(bd_phys(dma, rx_bd(dma, (i + 1) % AXI_DMA_SG_RING))));
+        rx_bd(dma, i)->next_msb = cpu_to_le32(upper_32_bits(bd_phys(dma, rx_bd(dma, (i + 1) % AXI_DMA_SG_RING))));
+    }
+    dma->tx_bd = 0;
+    dma->rx_bd = 0;
+    return 0;
+}
+
+/**
+ * axi_dma_sg_release - Free the descriptor rings
+ *
+ * @dma: The core, which must have been halted
+ * @dev: Device that the rings were allocated for
+ */
+void axi_dma_sg_release(struct axi_dma *dma, struct device *dev) {
+    dma_free_coherent(dev, 2 * AXI_DMA_SG_RING * sizeof(struct axi_dma_bd), dma->bds, dma->bds_phys);
+    dma->bds = NULL;
+}
+
+/**
+ * axi_dma_sg_reset - Reset the DMA core
+ *
+ * @dma: The core
+ *
+ * This function return zero in case of success, and an error code otherwise.
+ */
+int axi_dma_sg_reset(struct axi_dma *dma) {
+    return axi_dma_simple_reset(dma);
+}
+
+/**
+ * axi_dma_sg_halt - Halt both channels
+ *
+ * @dma: The core
+ *
+ * This function return zero in case of success, and an error code otherwise.
+ */
+int axi_dma_sg_halt(struct axi_dma *dma) {
+    return axi_dma_simple_halt(dma);
+}
+
+/**
+ * axi_dma_sg_setup_tx - Set up MM2S channel for sending data
+ *
+ * @dma: The core
+ * @src: Address of the source data buffer
+ * @virt: Unused
+ *
+ * This function halts the MM2S channel, restarts its ring at the first descriptor
+ * and puts it into the run state. Nothing is fetched before axi_dma_sg_start_tx().
+ *
+ * This function return zero in case of success, and an error code otherwise.
+ */
+int axi_dma_sg_setup_tx(struct axi_dma *dma, dma_addr_t src, void *virt) {
+    uint32_t reg_val = 0;
+    int err;
+
+    err = stop_chan(dma, AXI_MM2S_DMACR, AXI_MM2S_DMASR);
+    if (err)
+        return err;
+    dma->tx_bd = 0;
+    set_buf(dma, tx_bd(dma, 0), src);
+    write_desc(dma, bd_phys(dma, tx_bd(dma, 0)), AXI_MM2S_CURDESC, AXI_MM2S_CURDESC_MSB);
+
+    // Start channel with masked interrupts
+    reg_val |= (((uint32_t)1) << AXI_MM2S_DMACR_RS);
+    reg_val |= (((uint32_t)1) << AXI_MM2S_DMACR_IOC_IrqEn);
+    reg_val |= (((uint32_t)1) << AXI_MM2S_DMACR_Dly_IrqEn);
+    reg_val |= (((uint32_t)1) << AXI_MM2S_DMACR_Err_IrqEn);
+    reg_wr(reg_val, dma->base_addr, AXI_MM2S_DMACR);
+    return 0;
+}
+
+/**
+ * axi_dma_sg_load_tx - Prepare the next MM2S descriptor of a running channel
+ *
+ * @dma: The core
+ * @src: Address of the source data buffer
+ * @virt: Unused
+ *
+ * The core is idle at the descriptor of the previous transfer, and fetches the one
+ * after it once the tail pointer moves there. A ring of two suffices, as the previous
+ * transfer has completed before the next one is loaded.
+ *
+ * This function return zero in case of success, and an error code otherwise.
+ */
+int axi_dma_sg_load_tx(struct axi_dma *dma, dma_addr_t src, void *virt) {
+    // Clear the completion flag of the previous transfer (write one to clear)
+    reg_wr(((uint32_t)1) << AXI_MM2S_DMASR_IOC_Irq, dma->base_addr, AXI_MM2S_DMASR);
+
+    dma->tx_bd = (dma->tx_bd + 1) % AXI_DMA_SG_RING;
+    set_buf(dma, tx_bd(dma, dma->tx_bd), src);
+    return 0;
+}
+
+/**
+ * axi_dma_sg_start_tx - Start a previously set up MM2S transfer
+ *
+ * @dma: The core
+ * @sz: The number of bytes to transmit from the source buffer
+ *
+ * The transfer is a single frame, so its descriptor is both the first and the last.
+ * The call will not block.
+ *
+ * This function return zero in case of success, and an error code otherwise.
+ */
+int axi_dma_sg_start_tx(struct axi_dma *dma, size_t sz) {
+    struct axi_dma_bd *bd = tx_bd(dma, dma->tx_bd);
+
+    arm_bd(bd, ((uint32_t)sz & AXI_BD_CTRL_LEN_MASK) | ((uint32_t)1 << AXI_BD_CTRL_TXSOF)
+               | ((uint32_t)1 << AXI_BD_CTRL_TXEOF));
+    write_desc(dma, bd_phys(dma, bd), AXI_MM2S_TAILDESC, AXI_MM2S_TAILDESC_MSB);
+    return 0;
+}
+
+/**
+ * axi_dma_sg_setup_rx - Setup S2MM channel for receiving data
+ *
+ * @dma: The core
+ * @dest: Destination data buffer
+ * @virt: Unused
+ * @sz: Number of bytes in the destination buffer
+ *
+ * This function halts the S2MM channel, restarts its ring at the first descriptor,
+ * puts it into the run state and enables it to receive data.
+ *
+ * This function return zero in case of success, and an error code otherwise.
+ */
+int axi_dma_sg_setup_rx(struct axi_dma *dma, dma_addr_t dest, void *virt, size_t sz) {
+    uint32_t reg_val = 0;
+    int err;
+
+    err = stop_chan(dma, AXI_S2MM_DMACR, AXI_S2MM_DMASR);
+    if (err)
+        return err;
+    dma->rx_bd = 0;
+    set_buf(dma, rx_bd(dma, 0), dest);
+    arm_bd(rx_bd(dma, 0), (uint32_t)sz & AXI_BD_CTRL_LEN_MASK);
+    write_desc(dma, bd_phys(dma, rx_bd(dma, 0)), AXI_S2MM_CURDESC, AXI_S2MM_CURDESC_MSB);
+
+    // Setup channel with masked interrupts
+    reg_val |= (((uint32_t)1) << AXI_S2MM_DMACR_RS);
+    reg_val |= (((uint32_t)1) << AXI_S2MM_DMACR_IOC_IRqEn);
+    reg_val |= (((uint32_t)1) << AXI_S2MM_DMACR_Dly_IrqEn);
+    reg_val |= (((uint32_t)1) << AXI_S2MM_DMACR_Err_IrqEn);
+    reg_wr(reg_val, dma->base_addr, AXI_S2MM_DMACR);
+
+    write_desc(dma, bd_phys(dma, rx_bd(dma, 0)), AXI_S2MM_TAILDESC, AXI_S2MM_TAILDESC_MSB);
+    return 0;
+}
+
+/**
+ * axi_dma_sg_load_rx - Hand the next S2MM descriptor to a running channel
+ *
+ * @dma: The core
+ * @dest: Destination data buffer
+ * @virt: Unused
+ * @sz: Number of bytes in the destination buffer
+ *
+ * See axi_dma_sg_load_tx(). Moving the tail pointer enables the channel to receive data.
+ *
+ * This function return zero in case of success, and an error code otherwise.
+ */
+int axi_dma_sg_load_rx(struct axi_dma *dma, dma_addr_t dest, void *virt, size_t sz) {
+    // Clear the completion flag of the previous transfer (write one to clear)
+    reg_wr(((uint32_t)1) << AXI_S2MM_DMASR_IOC_Irq, dma->base_addr, AXI_S2MM_DMASR);
+
+    dma->rx_bd = (dma->rx_bd + 1) % AXI_DMA_SG_RING;
+    set_buf(dma, rx_bd(dma, dma->rx_bd), dest);
+    arm_bd(rx_bd(dma, dma->rx_bd), (uint32_t)sz & AXI_BD_CTRL_LEN_MASK);
+    write_desc(dma, bd_phys(dma, rx_bd(dma, dma->rx_bd)), AXI_S2MM_TAILDESC, AXI_S2MM_TAILDESC_MSB);
+    return 0;
+}
+
+/**
+ * axi_dma_sg_tx_done - Check whether the MM2S transfer has completed
+ *
+ * @dma: The core
+ *
+ * The core sets the completion or an error bit in the status word of the descriptor.
+ *
+ * This function returns a positive value if the transfer has completed, zero while it
+ * is running, and an error code if the channel has reported an error.
+ */
+int axi_dma_sg_tx_done(struct axi_dma *dma) {
+    return bd_done(dma, tx_bd(dma, dma->tx_bd), AXI_MM2S_DMASR);
+}
+
+/**
+ * axi_dma_sg_rx_done - Check whether the S2MM transfer has completed
+ *
+ * @dma: The core
+ *
+ * The core sets the completion or an error bit in the status word of the descriptor.
+ *
+ * This function returns a positive value if the transfer has completed, zero while it
+ * is running, and an error code if the channel has reported an error.
+ */
+int axi_dma_sg_rx_done(struct axi_dma *dma) {
+    return bd_done(dma, rx_bd(dma, dma->rx_bd), AXI_S2MM_DMASR);
+}
+
+const struct axi_dma_ops axi_dma_sg_ops = {
+    .name       = "sg",
+    .init       = axi_dma_sg_init,
+    .release    = axi_dma_sg_release,
+    .reset      = axi_dma_sg_reset,
+    .halt       = axi_dma_sg_halt,
+    .setup_tx   = axi_dma_sg_setup_tx,
+    .load_tx    = axi_dma_sg_load_tx,
+    .start_tx   = axi_dma_sg_start_tx,
+    .setup_rx   = axi_dma_sg_setup_rx,
+    .load_rx    = axi_dma_sg_load_rx,
+    .tx_done    = axi_dma_sg_tx_done,
+    .rx_done    = axi_dma_sg_rx_done,
+};
@@ -0,0 +1,79 @@
+#include <linux/errno.h>    // Linux error codes
+#include <linux/swab.h>     // swab32
+#include <asm/byteorder.h> // le32_to_cpu and friends
+#include <asm/io.h>         // iowrite32 and ioread32
+#include "axi_xform_iface.h"
+
+/**
+ * axi_xform_probe - Check that a data_xform core is present
+ *
+ * @xform_addr: Memory mapped address of the data_xform core
+ *
+ * This function reads the identification register of the core and selects the
+ * invert transform, which matches the behaviour of the plain data_inv core.
+ *
+ * This function return zero in case of success, and an error code otherwise.
+ */
+int axi_xform_probe(void *xform_addr) {
+    if (!xform_addr)
+        return -EINVAL;
+
+    if (ioread32((uint8_t *)xform_addr + AXI_XFORM_ID) != AXI_XFORM_ID_V1)
+        return -ENODEV;
+
+    axi_xform_set(xform_addr, AXI_XFORM_OP_INVERT, 0);
+    return 0;
+}
+
+/**
+ * axi_xform_set - Select the transform of the core
+ *
+ * @xform_addr: Memory mapped address of the data_xform core
+ * @op: One of the AXI_XFORM_OP_* transforms
+ * @key: Key of the XOR transform, ignored by the others
+ *
+ * No packet may be in flight through the core while the transform is changed.
+ */
+void axi_xform_set(void *xform_addr, uint32_t op, uint32_t key) {
+    iowrite32(key, (uint8_t *)xform_addr + AXI_XFORM_KEY);
+    iowrite32(op, (uint8_t *)xform_addr + AXI_XFORM_OP);
+}
+
+/**
+ * axi_xform_model - Apply a transform in software, the way the core does
+ *
+ * @op: One of the AXI_XFORM_OP_* transforms
+ * @key: Key of the XOR transform, ignored by the others
+ * @data: The data, which is transformed in place as a single packet
+ * @sz: Number of bytes, must be a multiple of four for all transforms but the inversion
+ *
+ * The core works on the 32-bit lanes of the stream, which carry the words of the
+ * buffer in little-endian byte order.
+ */
+void axi_xform_model(uint32_t op, uint32_t key, void *data, size_t sz) {
+    __le32 *words = (__le32 *)data;
+    uint8_t *bytes = (uint8_t *)data;
+    uint32_t sum = 0;
+    size_t i;
+
+    switch (op) {
+        case AXI_XFORM_OP_INVERT:
+            for (i = 0; i < sz; i++)
+                bytes[i] = ~bytes[i];
+            break;
+        case AXI_XFORM_OP_BSWAP:
+            for (i = 0; i < sz / 4; i++)
+                words[i] = cpu_to_le32(swab32(le32_to_cpu(words[i])));
+            break;
+        case AXI_XFORM_OP_XOR:
+            for (i = 0; i < sz / 4; i++)
+                words[i] = cpu_to_le32(le32_to_cpu(words[i]) ^ key);
+            break;
+        case AXI_XFORM_OP_CSUM:
+            for (i = 0; i < sz / 4; i++) {
+                sum ^= le32_to_cpu(words[i]);
+                words[i] = cpu_to_le32(sum);
+            }
+            break;
+    }
+}
@@ -0,0 +1,34 @@
+#ifndef __AXI_XFORM_IFACE_H_
+#define __AXI_XFORM_IFACE_H_
+
+#include <linux/types.h>        // uintX_t and friends
+
+
+/************************************************************************************
+* data_xform register-related defines (see hw/data_xform_v1_0.vhd)
+************************************************************************************/
+
+// Transform applied to the stream, only to be changed between packets
+#define AXI_XFORM_OP            0x00
+#define AXI_XFORM_OP_INVERT     0       // Invert every bit
+#define AXI_XFORM_OP_BSWAP      1       // Reverse the byte order of every 32-bit word
+#define AXI_XFORM_OP_XOR        2       // XOR every 32-bit word with the key
+#define AXI_XFORM_OP_CSUM       3       // Running XOR checksum of the 32-bit words of the packet
+#define AXI_XFORM_NUM_OPS       4
+
+// Key of the XOR transform
+#define AXI_XFORM_KEY           0x04
+
+// Identification register
+#define AXI_XFORM_ID            0x08
+#define AXI_XFORM_ID_V1         0x58464D01
+
+
+/************************************************************************************
+* data_xform interfacing function declarations
+************************************************************************************/
+int axi_xform_probe(void *xform_addr);
+void axi_xform_set(void *xform_addr, uint32_t op, uint32_t key);
+void axi_xform_model(uint32_t op, uint32_t key, void *data, size_t sz);
+
+#endif  // __AXI_XFORM_IFACE_H_
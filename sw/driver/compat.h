@@ -0,0 +1,69 @@
+#ifndef __COMPAT_H_
+#define __COMPAT_H_
+
+#include <linux/version.h>      // LINUX_VERSION_CODE and KERNEL_VERSION
+#include <linux/sched.h>        // struct task_struct, SCHED_*
+
+
+/************************************************************************************
+* Shims for kernel API changes the driver has to build across
+************************************************************************************/
+
+// kzfree() was renamed to kfree_sensitive()
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 9, 0)
+#define kzfree(p)                   kfree_sensitive(p)
+#endif
+
+// class_create() no longer takes the owning module
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 4, 0)
+#define class_create(owner, name)   class_create(name)
+#endif
+
+// generic_file_splice_read() was replaced by copy_splice_read() for files without a page cache
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 5, 0)
+#define generic_file_splice_read    copy_splice_read
+#endif
+
+// io_uring passthrough commands for character devices, with the
+// io_uring_sqe_cmd() and four-argument io_uring_cmd_done() interface
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 6, 0)
+#define DMA_PROXY_HAS_URING_CMD
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 7, 0)
+#include <linux/io_uring/cmd.h>
+#else
+#include <linux/io_uring.h>
+#endif
+#endif
+
+// irq_set_affinity_hint() no longer applies the affinity, only the hint
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 17, 0)
+#define irq_set_affinity_and_hint   irq_set_affinity_hint
+#endif
+
+// sched_setscheduler_nocheck() is no longer exported to modules, sched_setattr_nocheck() is.
+// @prio is the real-time priority for SCHED_FIFO and SCHED_RR, and the nice value for SCHED_NORMAL.
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 9, 0)
+#include <uapi/linux/sched/types.h>
+static inline int dma_proxy_setscheduler(struct task_struct *p, int policy, int prio) {
+    struct sched_attr attr = {
+        .size           = sizeof(attr),
+        .sched_policy   = policy,
+        .sched_priority = policy == SCHED_NORMAL ? 0 : prio,
+        .sched_nice     = policy == SCHED_NORMAL ? prio : 0,
+    };
+
+    return sched_setattr_nocheck(p, &attr);
+}
+#else
+static inline int dma_proxy_setscheduler(struct task_struct *p, int policy, int prio) {
+    struct sched_param param = {.sched_priority = policy == SCHED_NORMAL ? 0 : prio};
+    int err;
+
+    err = sched_setscheduler_nocheck(p, policy, &param);
+    if (!err && policy == SCHED_NORMAL)
+        set_user_nice(p, prio);
+    return err;
+}
+#endif
+
+#endif  // __COMPAT_H_
@@ -2,27 +2,241 @@
 #include <linux/platform_device.h>  // Platform_device struct and related functions
 #include <linux/slab.h>             // kmalloc and friends
 #include <linux/dma-mapping.h>      // DMA mapping API, dma_*_coherent
+#include <linux/of.h>               // Device tree property access
+#include <linux/of_irq.h>           // of_irq_get
 #include <asm/io.h>                 // MMIO via ioremap
 #include <asm/uaccess.h>            // copy_from_user
 #include <linux/kthread.h>          // kernel threads
+#include <linux/ktime.h>            // ktime_get_ns
 #include "dma_proxy_driver.h"
 #include "axi_dma_iface.h"
+#include "axi_dma_engine.h"
+#include "axi_xform_iface.h"
+#include "dma_proxy_stats.h"
 #include "types.h"
 
+#define CREATE_TRACE_POINTS
+#include "dma_proxy_trace.h"
+
+/************************************************************************************
+* Module parameters
+************************************************************************************/
+static bool allow_bypass = false;
+module_param(allow_bypass, bool, 0644);
+MODULE_PARM_DESC(allow_bypass, "Allow processes with CAP_SYS_RAWIO to program the core directly from user space");
+
+static unsigned int xfer_timeout_ms = 1000;
+module_param(xfer_timeout_ms, uint, 0644);
+MODULE_PARM_DESC(xfer_timeout_ms, "Time after which a transfer fails and the core is reset or its dmaengine jobs aborted, 0 for no limit (default 1000)");
+
+static unsigned int model_stalls = 0;
+module_param(model_stalls, uint, 0644);
+MODULE_PARM_DESC(model_stalls, "Number of upcoming transfers of the software model whose S2MM stalls until xfer_timeout_ms, for testing error recovery (default 0)");
+
+static int completion_cpu = -1;
+module_param(completion_cpu, int, 0444);
+MODULE_PARM_DESC(completion_cpu, "CPU that handles transfer completions, -1 for any (default -1)");
+
+static int completion_policy = SCHED_NORMAL;
+module_param(completion_policy, int, 0444);
+MODULE_PARM_DESC(completion_policy, "Scheduling policy of the completion threads, 0 normal, 1 FIFO, 2 RR (default 0)");
+
+static int completion_prio = 0;
+module_param(completion_prio, int, 0444);
+MODULE_PARM_DESC(completion_prio, "Priority of the completion threads, 1-99 for FIFO and RR, a nice value for normal (default 0)");
+
+
+/************************************************************************************
+* Completion path placement
+*
+* The register backends complete transfers from kernel threads, the dmaengine backend
+* from the interrupts of the provider. Both can be kept on a CPU of their own, away from
+* the processes consuming the data, and the threads can be given a real-time policy.
+************************************************************************************/
+
+/**
+ * dma_proxy_completion_check - Validate completion settings
+ *
+ * @cpu: CPU to handle completions on, -1 for any
+ * @policy: Scheduling policy of the completion threads
+ * @prio: Real-time priority for SCHED_FIFO and SCHED_RR, nice value for SCHED_NORMAL
+ *
+ * This function returns zero if the settings are valid, and -EINVAL otherwise.
+ */
+static int dma_proxy_completion_check(int cpu, int policy, int prio) {
+    if (cpu < -1 || (cpu >= 0 && (cpu >= nr_cpu_ids || !cpu_online(cpu))))
+        return -EINVAL;
+
+    switch (policy) {
+        case SCHED_NORMAL:
+            return prio < MIN_NICE || prio > MAX_NICE ? -EINVAL : 0;
+        case SCHED_FIFO:
+        case SCHED_RR:
+            return prio < 1 || prio >= MAX_RT_PRIO ? -EINVAL : 0;
+        default:
+            return -EINVAL;
+    }
+}
+
+/**
+ * dma_proxy_completion_task - Apply the completion settings to a kernel thread
+ *
+ * @task: The thread
+ *
+ * This function must be called with completion_lock held.
+ *
+ * This function return zero in case of success, and an error code otherwise.
+ */
+static int dma_proxy_completion_task(struct task_struct *task) {
+    int err;
+
+    err = set_cpus_allowed_ptr(task, completion_cpu >= 0 ? cpumask_of(completion_cpu) : cpu_possible_mask);
+    if (err)
+        return err;
+
+    return dma_proxy_setscheduler(task, completion_policy, completion_prio);
+}
+
+/**
+ * dma_proxy_completion_irqs - Steer the interrupts of the dmaengine backend
+ *
+ * @mask: CPUs to handle the interrupts on, NULL to only drop the hint
+ *
+ * The driver does not request the interrupts of the channels itself, they belong to the
+ * provider, which runs the completion callbacks from them. This does nothing for the
+ * register backends, which poll the core.
+ *
+ * This function must be called with completion_lock held.
+ */
+static void dma_proxy_completion_irqs(const struct cpumask *mask) {
+    if (ip_info.backend != DMA_PROXY_BACKEND_ENGINE)
+        return;
+
+    if (ip_info.tx_irq)
+        irq_set_affinity_and_hint(ip_info.tx_irq, mask);
+    if (ip_info.rx_irq)
+        irq_set_affinity_and_hint(ip_info.rx_irq, mask);
+}
+
+/**
+ * dma_proxy_completion_run - Start a kernel thread on the completion path
+ *
+ * @fn: Function run by the thread
+ * @data: Argument of @fn
+ * @name: Name of the thread
+ *
+ * Like kthread_run(), but the thread is placed according to the completion settings before
+ * it first runs. Placement is best effort, a CPU that went offline since it was selected
+ * does not fail the transfer.
+ *
+ * This function returns the thread, or an ERR_PTR() in case of failure.
+ */
+static struct task_struct *dma_proxy_completion_run(int (*fn)(void *), void *data, const char *name) {
+    struct task_struct *task;
+
+    task = kthread_create(fn, data, "%s", name);
+    if (IS_ERR(task))
+        return task;
+
+    mutex_lock(&completion_lock);
+    dma_proxy_completion_task(task);
+    mutex_unlock(&completion_lock);
+    wake_up_process(task);
+    return task;
+}
+
+
 /************************************************************************************
 * Helper functions
 ************************************************************************************/
 
+/**
+ * dma_proxy_get_buf - Look up a buffer of an instance by its handle
+ *
+ * @instp: The instance owning the buffer
+ * @handle: Handle of the buffer
+ *
+ * This function returns the buffer, or NULL if the handle does not refer to an allocated buffer.
+ */
+static struct dma_proxy_buf *dma_proxy_get_buf(struct dma_proxy_inst *instp, uint32_t handle) {
+    if (!instp || handle >= MAX_BUFS || !instp->bufs[handle].dma_buf_virt)
+        return NULL;
+
+    return &instp->bufs[handle];
+}
+
+/**
+ * dma_proxy_alloc_buf - Allocate a DMA buffer for an instance
+ *
+ * @instp: The instance that will own the buffer
+ * @handle: Handle of the buffer
+ * @sz: Size of the buffer in bytes
+ *
+ * This function must be called with instp->buf_lock held.
+ *
+ * This function returns zero in case of success, and an error code otherwise.
+ */
+static int dma_proxy_alloc_buf(struct dma_proxy_inst *instp, uint32_t handle, size_t sz) {
+    struct dma_proxy_buf *buf = &instp->bufs[handle];
+
+    if (!sz || sz > ip_info.max_xfer)
+        return -EINVAL;
+    if (buf->dma_buf_virt)
+        return -EINVAL;
+
+    buf->dma_buf_virt = dma_alloc_coherent(ip_info.dma_dev, sz, &buf->dma_buf_phys, GFP_KERNEL);
+    if (!buf->dma_buf_virt)
+        return -ENOMEM;
+
+    // Without a realignment engine, the core only accepts addresses aligned to its data width
+    if (!IS_ALIGNED(buf->dma_buf_phys, ip_info.xfer_align)) {
+        dma_free_coherent(ip_info.dma_dev, sz, buf->dma_buf_virt, buf->dma_buf_phys);
+        buf->dma_buf_virt = NULL;
+        return -EINVAL;
+    }
+    buf->buf_sz = sz;
+    atomic_set(&buf->pending, 0);
+    return 0;
+}
+
+/**
+ * dma_proxy_free_buf - Free a DMA buffer of an instance
+ *
+ * @instp: The instance owning the buffer
+ * @handle: Handle of the buffer
+ *
+ * This function must be called with instp->buf_lock held.
+ *
+ * This function returns zero in case of success, and an error code otherwise.
+ */
+static int dma_proxy_free_buf(struct dma_proxy_inst *instp, uint32_t handle) {
+    struct dma_proxy_buf *buf = dma_proxy_get_buf(instp, handle);
+
+    if (!buf)
+        return -EFAULT;
+    if (atomic_read(&buf->pending) || !completion_done(&buf->job.rx_done))
+        return -EBUSY;
+
+    dma_free_coherent(ip_info.dma_dev, buf->buf_sz, buf->dma_buf_virt, buf->dma_buf_phys);
+    buf->dma_buf_virt = NULL;
+    buf->dma_buf_phys = 0;
+    buf->buf_sz = 0;
+    return 0;
+}
+
 /**
  * release_inst - Remove a single instance of resources
  *
  * @instp: a pointer to the instance to be freed
  *
- * This function releases a single dma_proxy_inst.
+ * This function releases a single dma_proxy_inst along with all of its buffers.
  */
 static void release_inst(struct dma_proxy_inst *instp) {
-    if (instp && instp->dma_buf_virt) {
-        dma_free_coherent(&ip_info.ofdev->dev, instp->buf_sz, instp->dma_buf_virt, instp->dma_buf_phys);
+    uint32_t i;
+
+    if (instp) {
+        for (i = 0; i < MAX_BUFS; i++)
+            dma_proxy_free_buf(instp, i);
 
         // Finally, release private_data
         kzfree(instp);
@@ -44,321 +258,2197 @@ static void release_all_resources(void) {
         }
     }
 
-    // Kill the RX synchronization thread if it is running
-    if (sync_rx_thread)
-        kthread_stop(sync_rx_thread);
+    kzfree(instances);
+}
+
+/**
+ * dma_proxy_lease_end - End the current lease
+ *
+ * This function must be called with ip_info.lease_lock held.
+ */
+static void dma_proxy_lease_end(void) {
+    ip_info.lease_prev = ip_info.lease_owner;
+    ip_info.lease_owner = NULL;
+    ip_info.lease_jobs = 0;
+    ip_info.lease_bypass = false;
+    wake_up_all(&ip_info.lease_wq);
+}
+
+/**
+ * dma_proxy_lease_blocks - Check whether the hardware is leased to another instance
+ *
+ * @instp: The instance that wants to use the hardware
+ *
+ * This function must be called with ip_info.lease_lock held. A lease that has
+ * run out of time is ended here, which is what enforces its expiry. Bypass leases
+ * do not expire, they last until the holder closes its file descriptor.
+ *
+ * This function returns true if another instance holds a lease that is still in effect.
+ */
+static bool dma_proxy_lease_blocks(struct dma_proxy_inst *instp) {
+    if (!ip_info.lease_owner)
+        return false;
+
+    if (!ip_info.lease_bypass && time_after_eq(jiffies, ip_info.lease_expires)) {
+        dma_proxy_lease_end();
+        return false;
+    }
+
+    return ip_info.lease_owner != instp;
+}
+
+/**
+ * dma_proxy_lease_check - Locked wrapper around dma_proxy_lease_blocks()
+ *
+ * @instp: The instance that wants to use the hardware
+ * @left: Returns the number of jiffies until the blocking lease expires
+ *
+ * This function returns true if another instance holds a lease that is still in effect.
+ */
+static bool dma_proxy_lease_check(struct dma_proxy_inst *instp, long *left) {
+    bool blocks;
+
+    spin_lock(&ip_info.lease_lock);
+    blocks = dma_proxy_lease_blocks(instp);
+    if (blocks && ip_info.lease_bypass)
+        *left = msecs_to_jiffies(MAX_LEASE_MS);
+    else
+        *left = blocks ? (long)(ip_info.lease_expires - jiffies) + 1 : 0;
+    spin_unlock(&ip_info.lease_lock);
+    return blocks;
+}
+
+/**
+ * dma_proxy_lease_wait - Wait until no lease of another instance is in effect
+ *
+ * @instp: The instance that wants to use the hardware
+ *
+ * This function returns zero once the hardware is not leased to another instance,
+ * and -ERESTARTSYS if the wait was interrupted.
+ */
+static int dma_proxy_lease_wait(struct dma_proxy_inst *instp) {
+    long left;
+
+    // Nobody is woken up when a lease runs out of time, so sleep no longer than that
+    while (dma_proxy_lease_check(instp, &left)) {
+        if (wait_event_interruptible_timeout(ip_info.lease_wq, !dma_proxy_lease_check(instp, &left), left) < 0)
+            return -ERESTARTSYS;
+    }
+
+    return 0;
+}
+
+/**
+ * dma_proxy_ts - Read the clock that the phases of transfers are timestamped with
+ *
+ * This is the free-running counter in the PL if the design has one, see
+ * dma_proxy_setup_ts(), and the kernel clock otherwise. The counter is read
+ * upper half first, and again if that changed while reading the lower half.
+ *
+ * This function returns the timestamp in counter ticks or in nanoseconds, respectively.
+ */
+static u64 dma_proxy_ts(void) {
+    uint32_t hi, lo;
+
+    if (!ip_info.ts_addr)
+        return ktime_get_ns();
+
+    do {
+        hi = ioread32((uint8_t *)ip_info.ts_addr + 4);
+        lo = ioread32(ip_info.ts_addr);
+    } while (ioread32((uint8_t *)ip_info.ts_addr + 4) != hi);
+    return ((u64)hi << 32) | lo;
+}
+
+// Timestamp a phase of a transfer
+static inline void dma_proxy_stamp(struct dma_proxy_job *job, enum dma_proxy_ts phase) {
+    job->ts[phase] = dma_proxy_ts();
+}
+
+/**
+ * dma_proxy_phase_ns - Time a transfer spent between two phases
+ *
+ * @job: The transfer
+ * @from: The phase at which the time starts
+ * @to: The phase at which the time ends
+ *
+ * This function returns the time in nanoseconds, or zero if the transfer did not reach @to.
+ */
+static u64 dma_proxy_phase_ns(const struct dma_proxy_job *job, enum dma_proxy_ts from, enum dma_proxy_ts to) {
+    u64 ticks;
+
+    if (!job->ts[from] || job->ts[to] < job->ts[from])
+        return 0;
+
+    ticks = job->ts[to] - job->ts[from];
+    return ip_info.ts_addr ? mul_u64_u32_div(ticks, NSEC_PER_SEC, ip_info.ts_freq) : ticks;
+}
+
+/**
+ * dma_proxy_job_init - Prepare the state of a transfer
+ *
+ * @job: The transfer
+ * @instp: The instance that will submit it
+ * @rxsync: Whether the result is reported by DMAPROXY_IOCTRXSYNC
+ *
+ * Until it is submitted, waiting for the transfer does not block.
+ */
+static void dma_proxy_job_init(struct dma_proxy_job *job, struct dma_proxy_inst *instp, bool rxsync) {
+    job->instp = instp;
+    job->rxsync = rxsync;
+    INIT_LIST_HEAD(&job->node);
+    init_completion(&job->tx_done);
+    init_completion(&job->rx_done);
+    complete_all(&job->tx_done);
+    complete_all(&job->rx_done);
+}
+
+/**
+ * dma_proxy_acquire_hw - Acquire the hardware mutex for a transfer
+ *
+ * @job: The transfer, of the instance that wants to use the hardware
+ * @sz: Number of bytes it transfers
+ * @leased: Returns whether the transfer is covered by a lease of the instance
+ *
+ * This function blocks as long as another instance holds a lease. A transfer that
+ * is covered by a lease is charged against it, and the lease ends with its last one.
+ * An instance in bypass mode programs the core itself and cannot submit transfers.
+ * Once the hardware is acquired, the state of the transfer is reset for the new one,
+ * which fails with -EBUSY if the job is still in flight.
+ *
+ * This function returns zero with ip_info.hw_lock held, and an error code otherwise.
+ */
+static int dma_proxy_acquire_hw(struct dma_proxy_job *job, size_t sz, bool *leased) {
+    struct dma_proxy_inst *instp = job->instp;
+    u64 submit = ktime_get_ns();
+    u64 ts_submit = dma_proxy_ts();
+    bool blocks;
+    int err = 0;
+
+    if (instp->bypass)
+        return -EBUSY;
+
+    atomic_inc(&ip_info.hw_waiters);
+    for (;;) {
+        err = dma_proxy_lease_wait(instp);
+        if (err)
+            break;
+
+        // A lease may have been granted while sleeping on the mutex, so check once more
+        mutex_lock(&ip_info.hw_lock);
+        spin_lock(&ip_info.lease_lock);
+        blocks = dma_proxy_lease_blocks(instp);
+        if (!blocks) {
+            *leased = ip_info.lease_owner == instp;
+            // Channels armed for another lease are set up from scratch
+            if (!*leased || ip_info.armed_lease != ip_info.lease_seq)
+                ip_info.armed = false;
+            ip_info.armed_lease = ip_info.lease_seq;
+            if (*leased && !ip_info.lease_bypass && --ip_info.lease_jobs == 0)
+                dma_proxy_lease_end();
+            if (ip_info.lease_prev && ip_info.lease_prev != instp) {
+                ip_info.lease_prev = NULL;
+                wake_up_all(&ip_info.lease_wq);
+            }
+        }
+        spin_unlock(&ip_info.lease_lock);
+        if (!blocks)
+            break;
+        mutex_unlock(&ip_info.hw_lock);
+    }
+    atomic_dec(&ip_info.hw_waiters);
+    if (err)
+        return err;
+
+    // Another thread may have started a transfer on the same buffer in the meantime
+    if (!completion_done(&job->rx_done)) {
+        mutex_unlock(&ip_info.hw_lock);
+        return -EBUSY;
+    }
+    reinit_completion(&job->tx_done);
+    reinit_completion(&job->rx_done);
+    job->err = 0;
+    job->sz = sz;
+    job->submit = submit;
+    job->start = ktime_get_ns();
+    memset(job->ts, 0, sizeof(job->ts));
+    job->ts[DMA_PROXY_TS_SUBMIT] = ts_submit;
+    dma_proxy_stamp(job, DMA_PROXY_TS_START);
+    dma_proxy_stats_wait(&ip_info.stats, job->start - submit);
+    dma_proxy_stats_wait(&instp->stats, job->start - submit);
+    return 0;
+}
+
+/**
+ * dma_proxy_xfer_done - Account for a transfer that has finished and signal its result
+ *
+ * @job: The transfer
+ * @err: Zero if the transfer succeeded, an error code otherwise
+ *
+ * This function is called once for every transfer that acquired the hardware
+ * through dma_proxy_acquire_hw(), either on completion of S2MM or when the
+ * transfer is abandoned because of an error. The first error of the transfers
+ * started by ioctl() is kept for DMAPROXY_IOCTRXSYNC.
+ */
+static void dma_proxy_xfer_done(struct dma_proxy_job *job, int err) {
+    struct dma_proxy_inst *instp = job->instp;
+    u64 now = ktime_get_ns();
+    u64 phase_ns[DMA_PROXY_NUM_TS - 1];
+    int i;
+
+    dma_proxy_stats_done(&ip_info.stats, job->sz, now - job->start, now - job->submit, err);
+    dma_proxy_stats_done(&instp->stats, job->sz, now - job->start, now - job->submit, err);
+    for (i = 0; i < DMA_PROXY_NUM_TS - 1; i++)
+        phase_ns[i] = dma_proxy_phase_ns(job, i, i + 1);
+    trace_dma_proxy_done(job, now - job->submit, err, phase_ns);
+
+    job->err = err;
+    if (err && job->rxsync)
+        cmpxchg(&instp->sync_err, 0, err);
+    complete_all(&job->rx_done);
+}
+
+/**
+ * dma_proxy_lease_acquire - Grant an exclusive lease on the hardware
+ *
+ * @instp: The instance requesting the lease
+ * @max_jobs: Number of transfers covered by the lease
+ * @max_ms: Duration of the lease in milliseconds
+ * @bypass: Grant a lease for user-space access instead, which ignores both limits
+ *
+ * This function blocks until no other lease is in effect. To avoid starving others,
+ * the previous holder may only take a new lease once somebody else has used the
+ * hardware, unless nobody is waiting for it.
+ *
+ * This function returns zero in case of success, and an error code otherwise.
+ */
+static int dma_proxy_lease_acquire(struct dma_proxy_inst *instp, uint32_t max_jobs, uint32_t max_ms, bool bypass) {
+    int err = 0;
+
+    for (;;) {
+        err = dma_proxy_lease_wait(instp);
+        if (err)
+            return err;
+
+        spin_lock(&ip_info.lease_lock);
+        if (!dma_proxy_lease_blocks(instp) && ip_info.lease_owner == instp) {
+            // Leases cannot be renewed while in effect
+            spin_unlock(&ip_info.lease_lock);
+            return -EBUSY;
+        }
+        if (!ip_info.lease_owner && (ip_info.lease_prev != instp || !atomic_read(&ip_info.hw_waiters))) {
+            ip_info.lease_owner = instp;
+            ip_info.lease_jobs = max_jobs;
+            ip_info.lease_expires = jiffies + msecs_to_jiffies(max_ms);
+            ip_info.lease_bypass = bypass;
+            ip_info.lease_seq++;
+            spin_unlock(&ip_info.lease_lock);
+            return 0;
+        }
+        spin_unlock(&ip_info.lease_lock);
+
+        // Give the processes that waited during our previous lease their turn
+        if (wait_event_interruptible_timeout(ip_info.lease_wq, ip_info.lease_prev != instp
+                                             || !atomic_read(&ip_info.hw_waiters), msecs_to_jiffies(MAX_LEASE_MS)) < 0)
+            return -ERESTARTSYS;
+    }
+}
+
+/**
+ * dma_proxy_lease_release - End a lease held by an instance
+ *
+ * @instp: The instance that may hold the lease
+ */
+static void dma_proxy_lease_release(struct dma_proxy_inst *instp) {
+    spin_lock(&ip_info.lease_lock);
+    if (ip_info.lease_owner == instp)
+        dma_proxy_lease_end();
+    if (ip_info.lease_prev == instp)
+        ip_info.lease_prev = NULL;
+    spin_unlock(&ip_info.lease_lock);
+}
+
+/**
+ * dma_proxy_bypass_enter - Hand the core over to user space
+ *
+ * @instp: The instance of the process taking over the core
+ *
+ * This function takes a lease that lasts until the file descriptor is closed and
+ * waits for a transfer of another process that may still be running to complete.
+ *
+ * This function returns zero in case of success, and an error code otherwise.
+ */
+static int dma_proxy_bypass_enter(struct dma_proxy_inst *instp) {
+    int err = dma_proxy_lease_acquire(instp, 0, 0, true);
+    if (err)
+        return err;
+
+    mutex_lock(&ip_info.hw_lock);
+    instp->bypass = true;
+    mutex_unlock(&ip_info.hw_lock);
+    return 0;
+}
+
+/**
+ * dma_proxy_bypass_leave - Take the core back from user space
+ *
+ * @instp: The instance of the process that has taken over the core
+ *
+ * This function is called once the file descriptor has been closed, at which
+ * point no mapping of the registers can be left. The channels are reset, as
+ * user space may have left them in any state.
+ */
+static void dma_proxy_bypass_leave(struct dma_proxy_inst *instp) {
+    if (!instp->bypass)
+        return;
+
+    mutex_lock(&ip_info.hw_lock);
+    axi_dma_call(&ip_info.dma, reset);
+    axi_dma_call(&ip_info.dma, halt);
+    instp->bypass = false;
+    mutex_unlock(&ip_info.hw_lock);
+}
+
+/**
+ * dma_proxy_has_xform - Check whether the stream transform can be selected
+ *
+ * Either the design has a data_xform core, or the software model stands in for it.
+ */
+static bool dma_proxy_has_xform(void) {
+    return ip_info.xform_addr || ip_info.dma.ops == &axi_dma_model_ops;
+}
+
+/**
+ * dma_proxy_check_op - Check whether a transform can be applied to a transfer
+ *
+ * @op: One of the DMAPROXY_OP_* transforms
+ * @key: Key of the transform
+ * @sz: Number of bytes to transfer
+ *
+ * This function returns zero if the transfer is valid, and an error code otherwise.
+ */
+static int dma_proxy_check_op(uint32_t op, uint32_t key, size_t sz) {
+    if (op >= DMAPROXY_NUM_OPS || (key && op != DMAPROXY_OP_XOR))
+        return -EINVAL;
+    if (op != DMAPROXY_OP_INVERT && (sz % 4))
+        return -EINVAL;
+    if (op != DMAPROXY_OP_INVERT && !dma_proxy_has_xform())
+        return -EOPNOTSUPP;
+    return 0;
+}
+
+/**
+ * dma_proxy_set_op - Select the transform applied by the stream core, or by the software model
+ *
+ * @op: One of the DMAPROXY_OP_* transforms, as checked by dma_proxy_check_op()
+ * @key: Key of the transform
+ *
+ * The data_xform core may only be switched between packets. The register backend
+ * holds the hardware mutex until a transfer has completed, but the dmaengine provider
+ * may still be working on jobs that were issued before, so those are drained first.
+ * This function must be called with ip_info.hw_lock held.
+ *
+ * This function returns zero in case of success, and an error code otherwise.
+ */
+static int dma_proxy_set_op(uint32_t op, uint32_t key) {
+    int err = 0;
+
+    if (!dma_proxy_has_xform() || (op == ip_info.xform_op && key == ip_info.xform_key))
+        return 0;
+
+    if (ip_info.backend == DMA_PROXY_BACKEND_ENGINE) {
+        err = axi_dma_engine_drain(ip_info.rx_chan);
+        if (err)
+            return err;
+    }
+
+    if (ip_info.xform_addr) {
+        axi_xform_set(ip_info.xform_addr, op, key);
+    } else {
+        ip_info.dma.xform_op = op;
+        ip_info.dma.xform_key = key;
+    }
+    ip_info.xform_op = op;
+    ip_info.xform_key = key;
+    return 0;
+}
+
+/**
+ * dma_proxy_recover - Reset the core after a transfer of the register backends failed
+ *
+ * @instp: The instance whose transfer failed
+ * @err: The error of the transfer
+ *
+ * The core halts a channel that reports an error, and a channel that timed out may still
+ * wait for the stream. A soft reset returns both to their state after probing, and the
+ * next transfer sets them up from scratch, also during a lease.
+ * This function must be called with ip_info.hw_lock held.
+ */
+static void dma_proxy_recover(struct dma_proxy_inst *instp, int err) {
+    u64 start = ktime_get_ns();
+    u64 ns;
+    int ret;
+
+    ip_info.armed = false;
+    ret = axi_dma_call(&ip_info.dma, reset);
+    if (!ret)
+        ret = axi_dma_call(&ip_info.dma, halt);
+    ns = ktime_get_ns() - start;
+
+    dma_proxy_stats_recovery(&ip_info.stats, ns);
+    if (ret)
+        dev_err(&ip_info.ofdev->dev, "Transfer of pid %d failed (%d), the core did not come out of reset (%d)\n",
+                instp->pid, err, ret);
+    else
+        dev_warn(&ip_info.ofdev->dev, "Transfer of pid %d failed (%d), reset the core in %llu ns\n",
+                 instp->pid, err, (unsigned long long)ns);
+}
+
+/**
+ * dma_proxy_regs_rx_done - Finish a transfer of the register backends
+ *
+ * @job: The transfer
+ * @err: Zero if the transfer succeeded, an error code of the core otherwise
+ *
+ * This function is called from the RX synchronization thread with ip_info.hw_lock held.
+ */
+static void dma_proxy_regs_rx_done(struct dma_proxy_job *job, int err) {
+    if (err)
+        dma_proxy_recover(job->instp, err);
+    else
+        dma_proxy_stamp(job, DMA_PROXY_TS_S2MM);
+    dma_proxy_xfer_done(job, err);
+}
+
+/**
+ * dma_proxy_arm_regs - Program the core for a transfer and start MM2S
+ *
+ * @job: The transfer
+ * @buf: The buffer that is transferred
+ * @sz: Number of bytes to transfer
+ * @op: Transform applied to the data
+ * @key: Key of the transform
+ * @leased: Whether the transfer is covered by a lease of the instance
+ *
+ * During a lease the channels are kept in the run state, so after the first
+ * transfer only the address and length registers are rewritten.
+ * This function must be called with ip_info.hw_lock held.
+ *
+ * This function returns zero in case of success, and an error code otherwise.
+ */
+static int dma_proxy_arm_regs(struct dma_proxy_job *job, struct dma_proxy_buf *buf, size_t sz, uint32_t op,
+                              uint32_t key, bool leased) {
+    int err = 0;
+
+    err = dma_proxy_set_op(op, key);
+    if (err)
+        return err;
+    ip_info.dma.timeout_ms = READ_ONCE(xfer_timeout_ms);
+
+    if (leased && ip_info.armed) {
+        err = axi_dma_call(&ip_info.dma, load_tx, buf->dma_buf_phys, buf->dma_buf_virt);
+        if (!err)
+            err = axi_dma_call(&ip_info.dma, load_rx, buf->dma_buf_phys, buf->dma_buf_virt, sz);
+    } else {
+        // Setup a transfer to slave and the receive channel accordingly
+        err = axi_dma_call(&ip_info.dma, setup_tx, buf->dma_buf_phys, buf->dma_buf_virt);
+        if (!err)
+            err = axi_dma_call(&ip_info.dma, setup_rx, buf->dma_buf_phys, buf->dma_buf_virt, sz);
+        ip_info.armed = leased && !err;
+    }
+
+    // Initiate the transfer
+    if (err)
+        return err;
+    if (ip_info.dma.ops == &axi_dma_model_ops && READ_ONCE(model_stalls)) {
+        WRITE_ONCE(model_stalls, model_stalls - 1);
+        ip_info.dma.stalled = true;
+    }
+    dma_proxy_stamp(job, DMA_PROXY_TS_ARM);
+    return axi_dma_call(&ip_info.dma, start_tx, sz);
+}
+
+/**
+ * dma_proxy_start_regs - Start a transfer by programming the core directly
+ *
+ * @job: The transfer
+ * @buf: The buffer that is transferred
+ * @sz: Number of bytes to transfer
+ * @op: Transform applied to the data
+ * @key: Key of the transform
+ *
+ * This function blocks until the MM2S transfer is complete and hands the S2MM
+ * side to a kernel thread, which releases the hardware once data has been received
+ * and signals rx_done of the job.
+ *
+ * This function returns zero in case of success, and an error code otherwise.
+ */
+static int dma_proxy_start_regs(struct dma_proxy_job *job, struct dma_proxy_buf *buf, size_t sz,
+                                uint32_t op, uint32_t key) {
+    int err = 0;
+    bool leased = false;
+    struct rx_sync_dat *sync;
+    struct task_struct *task;
+
+    // Try to acquire hardware, block if necessary...
+    // Note that if acquired, the mutex will be freed by the rx synchronization thread
+    err = dma_proxy_acquire_hw(job, sz, &leased);
+    if (err)
+        return err;
+
+    err = dma_proxy_arm_regs(job, buf, sz, op, key, leased);
+    if (err)
+        goto err_unlock;
+
+    // Synchronize TX, this will block until the MM2S transfer is complete
+    err = axi_dma_sync_tx(&ip_info.dma);
+    if (err) {
+        dma_proxy_recover(job->instp, err);
+        goto err_unlock;
+    }
+    dma_proxy_stamp(job, DMA_PROXY_TS_MM2S);
+
+    // Start a kernel thread that will synchronize the RX channel and release the hardware
+    sync = (struct rx_sync_dat*)kzalloc(sizeof(struct rx_sync_dat), GFP_KERNEL);
+    if (!sync) {
+        err = -ENOMEM;
+        goto err_unlock;
+    }
+    sync->hw_lock = &ip_info.hw_lock;
+    sync->job = job;
+    sync->dma = &ip_info.dma;
+    sync->complete = dma_proxy_regs_rx_done;
+    task = dma_proxy_completion_run(axi_dma_sync_rx, sync, "dma_proxy_sync");
+    if (IS_ERR(task)) {
+        err = PTR_ERR(task);
+        kzfree(sync);
+        goto err_unlock;
+    }
+    return 0;
+
+err_unlock:
+    dma_proxy_xfer_done(job, err);
+    mutex_unlock(&ip_info.hw_lock);
+    return err;
+}
+
+/**
+ * dma_proxy_engine_tx_done - MM2S completion callback of the dmaengine backend
+ *
+ * @param: The transfer
+ * @result: Result of the transfer, as reported by the provider
+ */
+static void dma_proxy_engine_tx_done(void *param, const struct dmaengine_result *result) {
+    struct dma_proxy_job *job = (struct dma_proxy_job *)param;
+
+    // A failed MM2S transfer leaves S2MM waiting, dma_proxy_start_engine() aborts both
+    job->err = axi_dma_engine_result(result);
+    dma_proxy_stamp(job, DMA_PROXY_TS_MM2S);
+    complete_all(&job->tx_done);
+}
+
+/**
+ * dma_proxy_engine_rx_done - S2MM completion callback of the dmaengine backend
+ *
+ * @param: The transfer
+ * @result: Result of the transfer, as reported by the provider
+ */
+static void dma_proxy_engine_rx_done(void *param, const struct dmaengine_result *result) {
+    struct dma_proxy_job *job = (struct dma_proxy_job *)param;
+    int err = axi_dma_engine_result(result);
+    unsigned long flags;
+
+    spin_lock_irqsave(&engine_lock, flags);
+    list_del_init(&job->node);
+    spin_unlock_irqrestore(&engine_lock, flags);
+    if (!err)
+        dma_proxy_stamp(job, DMA_PROXY_TS_S2MM);
+    dma_proxy_xfer_done(job, err);
+}
+
+/**
+ * dma_proxy_engine_abort - Abort the jobs of the dmaengine backend after a transfer failed
+ *
+ * @job: The transfer that failed
+ * @err: The error the transfer failed with
+ *
+ * Terminating the channels also drops the jobs that other transfers queued behind the
+ * failed one. No callback runs for them anymore, so all of them fail right away with
+ * the same error. The transfer is not reported a second time if its S2MM callback ran
+ * in the meantime.
+ */
+static void dma_proxy_engine_abort(struct dma_proxy_job *job, int err) {
+    struct dma_proxy_job *pos, *tmp;
+    unsigned long flags;
+    LIST_HEAD(dropped);
+
+    mutex_lock(&ip_info.hw_lock);
+    axi_dma_engine_abort(ip_info.tx_chan, ip_info.rx_chan);
+
+    // The channels are idle and their callbacks have returned, whatever is left was dropped
+    spin_lock_irqsave(&engine_lock, flags);
+    list_splice_init(&engine_jobs, &dropped);
+    spin_unlock_irqrestore(&engine_lock, flags);
+    if (!list_empty(&dropped))
+        dev_err(&ip_info.ofdev->dev, "Transfer of pid %d failed (%d), aborted the dmaengine jobs\n",
+                job->instp->pid, err);
+    list_for_each_entry_safe(pos, tmp, &dropped, node) {
+        list_del_init(&pos->node);
+        dma_proxy_xfer_done(pos, err);
+        complete_all(&pos->tx_done);
+    }
+    complete_all(&job->tx_done);
+    mutex_unlock(&ip_info.hw_lock);
+}
+
+/**
+ * dma_proxy_wait_done - Wait for a channel of a transfer to complete
+ *
+ * @job: The transfer
+ * @done: tx_done or rx_done of the transfer
+ * @intr: Whether the wait may be interrupted by a signal
+ *
+ * The RX synchronization thread of the register backends bounds its wait on the core by
+ * itself. The dmaengine provider gives no such guarantee, so its jobs are aborted once
+ * xfer_timeout_ms has passed since their submission without the callback.
+ *
+ * This function returns zero once the channel has completed, and an error code otherwise.
+ * The result of the transfer itself is left in the err field of the job.
+ */
+static int dma_proxy_wait_done(struct dma_proxy_job *job, struct completion *done, bool intr) {
+    unsigned int ms = READ_ONCE(xfer_timeout_ms);
+    u64 deadline, now;
+    unsigned long timeout;
+    long left;
+
+    if (ip_info.backend != DMA_PROXY_BACKEND_ENGINE || !ms) {
+        if (intr)
+            return wait_for_completion_interruptible(done);
+        wait_for_completion(done);
+        return 0;
+    }
+
+    // A job that is already past its deadline is only checked for completion
+    deadline = job->submit + (u64)ms * NSEC_PER_MSEC;
+    now = ktime_get_ns();
+    timeout = now < deadline ? nsecs_to_jiffies(deadline - now) : 0;
+    if (intr)
+        left = wait_for_completion_interruptible_timeout(done, timeout);
+    else
+        left = wait_for_completion_timeout(done, timeout);
+    if (left < 0)
+        return left;
+    if (!left) {
+        dma_proxy_engine_abort(job, -ETIMEDOUT);
+        return -ETIMEDOUT;
+    }
+    return 0;
+}
+
+/**
+ * dma_proxy_start_engine - Start a transfer through the dmaengine provider
+ *
+ * @job: The transfer
+ * @buf: The buffer that is transferred
+ * @sz: Number of bytes to transfer
+ * @op: Transform applied to the data
+ * @key: Key of the transform
+ *
+ * The S2MM and MM2S descriptors of a job are queued under the hardware mutex,
+ * which keeps them paired up across processes. The provider serializes the
+ * jobs on its own, so the mutex is dropped as soon as both are issued.
+ * This function blocks until the MM2S transfer is complete, or at most for
+ * xfer_timeout_ms, S2MM completion is signalled through rx_done of the job.
+ *
+ * This function returns zero in case of success, and an error code otherwise.
+ */
+static int dma_proxy_start_engine(struct dma_proxy_job *job, struct dma_proxy_buf *buf, size_t sz,
+                                  uint32_t op, uint32_t key) {
+    int err = 0;
+    bool leased = false;
+    unsigned long flags;
+    struct dma_async_tx_descriptor *tx_desc, *rx_desc;
+
+    err = dma_proxy_acquire_hw(job, sz, &leased);
+    if (err)
+        return err;
+
+    err = dma_proxy_set_op(op, key);
+    if (err)
+        goto err_unlock;
+
+    // Build both descriptors before queueing either, so that a failure cannot leave
+    // a lone S2MM descriptor behind that would swallow the next job's stream
+    rx_desc = axi_dma_engine_prep(ip_info.rx_chan, buf->dma_buf_phys, sz, DMA_DEV_TO_MEM,
+                                  dma_proxy_engine_rx_done, job);
+    tx_desc = axi_dma_engine_prep(ip_info.tx_chan, buf->dma_buf_phys, sz, DMA_MEM_TO_DEV,
+                                  dma_proxy_engine_tx_done, job);
+    if (!rx_desc || !tx_desc) {
+        err = -ENOMEM;
+        goto err_unlock;
+    }
+
+    err = axi_dma_engine_submit(rx_desc);
+    if (err)
+        goto err_unlock;
+    err = axi_dma_engine_submit(tx_desc);
+    if (err) {
+        dmaengine_terminate_sync(ip_info.rx_chan);
+        goto err_unlock;
+    }
+
+    // The callbacks may run as soon as the jobs are issued
+    spin_lock_irqsave(&engine_lock, flags);
+    list_add_tail(&job->node, &engine_jobs);
+    spin_unlock_irqrestore(&engine_lock, flags);
+    dma_proxy_stamp(job, DMA_PROXY_TS_ARM);
+    axi_dma_engine_issue(ip_info.tx_chan, ip_info.rx_chan);
+    mutex_unlock(&ip_info.hw_lock);
+
+    err = dma_proxy_wait_done(job, &job->tx_done, false);
+    if (!err && job->err && !completion_done(&job->rx_done))
+        dma_proxy_engine_abort(job, job->err);
+    return err ? err : job->err;
+
+err_unlock:
+    dma_proxy_xfer_done(job, err);
+    complete_all(&job->tx_done);
+    mutex_unlock(&ip_info.hw_lock);
+    return err;
+}
+
+/**
+ * dma_proxy_start - Validate and start a transfer of one of the buffers of an instance
+ *
+ * @instp: The instance that submits the transfer
+ * @handle: Handle of the buffer to transfer
+ * @sz: Number of bytes to transfer
+ * @op: Transform applied to the data, one of DMAPROXY_OP_*
+ * @key: Key of the transform
+ *
+ * Transfers of different buffers may be in flight at the same time, a transfer of a buffer
+ * whose previous transfer has not completed yet waits for it first.
+ *
+ * This function returns zero in case of success, and an error code otherwise.
+ */
+static int dma_proxy_start(struct dma_proxy_inst *instp, uint32_t handle, size_t sz, uint32_t op, uint32_t key) {
+    struct dma_proxy_buf *buf = dma_proxy_get_buf(instp, handle);
+    int err = 0;
+
+    // Check if buffer already allocated and that sz is not greater than the buffer length
+    if (!buf || !sz || sz > ip_info.max_xfer || sz > buf->buf_sz)
+        return -EINVAL;
+    err = dma_proxy_check_op(op, key, sz);
+    if (err)
+        return err;
+
+    // The buffer must not be overwritten while S2MM may still write to it
+    err = dma_proxy_wait_done(&buf->job, &buf->job.rx_done, true);
+    if (err)
+        return err;
+
+    WRITE_ONCE(instp->last_job, &buf->job);
+    trace_dma_proxy_submit(instp, handle, sz, op, key);
+    if (ip_info.backend == DMA_PROXY_BACKEND_ENGINE)
+        return dma_proxy_start_engine(&buf->job, buf, sz, op, key);
+    else
+        return dma_proxy_start_regs(&buf->job, buf, sz, op, key);
+}
+
+/**
+ * dma_proxy_sync - Wait for all transfers an instance started by ioctl()
+ *
+ * @instp: The instance
+ * @intr: Whether the wait may be interrupted by a signal
+ *
+ * This function returns zero once all transfers have completed, and an error code otherwise.
+ */
+static int dma_proxy_sync(struct dma_proxy_inst *instp, bool intr) {
+    int i, err = 0;
+
+    for (i = 0; i < MAX_BUFS && !err; i++) {
+        err = dma_proxy_wait_done(&instp->bufs[i].job, &instp->bufs[i].job.rx_done, intr);
+        if (err == -ETIMEDOUT)
+            err = 0;
+    }
+    return err;
+}
+
+/************************************************************************************
+* File operation functions
+************************************************************************************/
+
+/**
+ * dma_proxy_open - open() syscall implementation
+ *
+ * @inodep: Unused
+ * @filep: A pointer to a struct file, corresponding to the file descriptor received by the
+ *         calling process
+ *
+ * This function implements the open() syscall for the driver.
+ * It allocates a dma_proxy_inst for the process and stores it in the private data.
+ *
+ * This function returns zero on success, and an error code otherwise.
+ */
+static int dma_proxy_open(struct inode *inodep, struct file *filep) {
+    struct dma_proxy_inst *instp;
+    int i;
+
+    mutex_lock(&inst_lock);
+    if (num_open < MAX_INST)
+        printk(KERN_INFO "dma_proxy: device file opened\n");
+    else {
+        mutex_unlock(&inst_lock);
+        return -EBUSY;
+    }
+
+    // Allocate private data for process
+    instp = kzalloc(sizeof(struct dma_proxy_inst), GFP_KERNEL);
+    if (!instp) {
+        mutex_unlock(&inst_lock);
+        return -ENOMEM;
+    }
+
+    // Initialize instance, the buffer table starts out empty
+    mutex_init(&instp->buf_lock);
+
+    // No transfer is pending yet, so synchronizing must not block
+    for (i = 0; i < MAX_BUFS; i++)
+        dma_proxy_job_init(&instp->bufs[i].job, instp, true);
+
+    // Remember who opened the file descriptor, for the statistics in sysfs
+    instp->pid = task_tgid_nr(current);
+    get_task_comm(instp->comm, current);
+
+    filep->private_data = instp;
+
+    // Track resources
+    for (i = 0; i < MAX_INST; i++) {
+        if (instances[i] == NULL) {
+            instances[i] = instp;
+            instp->slot = i;
+            break;
+        }
+    }
+    
+    num_open++;
+    mutex_unlock(&inst_lock);
+    return 0;
+}
+
+/**
+ * dma_proxy_buf_at - Look up the buffer a file position falls into
+ *
+ * @instp: The instance owning the buffers
+ * @pos: File position, see DMAPROXY_BUF_OFFSET()
+ * @offset: Returns the offset of the position within the buffer
+ *
+ * This function must be called with instp->buf_lock held.
+ *
+ * This function returns the buffer, or NULL if the position does not refer to an allocated buffer.
+ */
+static struct dma_proxy_buf *dma_proxy_buf_at(struct dma_proxy_inst *instp, loff_t pos, size_t *offset) {
+    if (pos < 0)
+        return NULL;
+
+    *offset = pos & (DMAPROXY_BUF_OFFSET(1) - 1);
+    return dma_proxy_get_buf(instp, pos >> DMAPROXY_BUF_SHIFT);
+}
+
+/**
+ * dma_proxy_read_iter - read() syscall implementation
+ *
+ * @iocb: I/O control block holding the file and the file position
+ * @to: Destination of the data
+ *
+ * This function copies data out of a DMA buffer. The buffer is selected by the file
+ * position in the same way as for mmap(), see DMAPROXY_BUF_OFFSET(). Reads never cross
+ * into the next buffer and hit end-of-file at the end of the current one.
+ * Together with generic_file_splice_read(), this lets S2MM output be spliced into a
+ * pipe, and from there into a socket, without passing through user space.
+ *
+ * This function returns the number of bytes read, and an error code otherwise.
+ */
+static ssize_t dma_proxy_read_iter(struct kiocb *iocb, struct iov_iter *to) {
+    struct dma_proxy_inst *instp = (struct dma_proxy_inst *)iocb->ki_filp->private_data;
+    struct dma_proxy_buf *buf;
+    size_t offset = 0, len = 0;
+
+    if (!instp)
+        return -EFAULT;
+
+    mutex_lock(&instp->buf_lock);
+    buf = dma_proxy_buf_at(instp, iocb->ki_pos, &offset);
+    if (!buf) {
+        mutex_unlock(&instp->buf_lock);
+        return -EINVAL;
+    }
+
+    if (offset < buf->buf_sz) {
+        len = copy_to_iter((uint8_t *)buf->dma_buf_virt + offset, min(iov_iter_count(to), buf->buf_sz - offset), to);
+        iocb->ki_pos += len;
+    }
+    mutex_unlock(&instp->buf_lock);
+    return len;
+}
+
+/**
+ * dma_proxy_write_iter - write() syscall implementation
+ *
+ * @iocb: I/O control block holding the file and the file position
+ * @from: Source of the data
+ *
+ * This function copies data into a DMA buffer, which is selected by the file position
+ * like for dma_proxy_read_iter(). Writes are cut short at the end of the buffer.
+ * Together with iter_file_splice_write(), this lets page cache pages be spliced
+ * into a buffer to feed MM2S without passing through user space.
+ *
+ * This function returns the number of bytes written, and an error code otherwise.
+ */
+static ssize_t dma_proxy_write_iter(struct kiocb *iocb, struct iov_iter *from) {
+    struct dma_proxy_inst *instp = (struct dma_proxy_inst *)iocb->ki_filp->private_data;
+    struct dma_proxy_buf *buf;
+    size_t offset = 0, want = 0, len = 0;
+
+    if (!instp)
+        return -EFAULT;
+
+    mutex_lock(&instp->buf_lock);
+    buf = dma_proxy_buf_at(instp, iocb->ki_pos, &offset);
+    if (!buf) {
+        mutex_unlock(&instp->buf_lock);
+        return -EINVAL;
+    }
+    if (offset >= buf->buf_sz) {
+        mutex_unlock(&instp->buf_lock);
+        return -ENOSPC;
+    }
+
+    want = min(iov_iter_count(from), buf->buf_sz - offset);
+    len = copy_from_iter((uint8_t *)buf->dma_buf_virt + offset, want, from);
+    iocb->ki_pos += len;
+    mutex_unlock(&instp->buf_lock);
+    return (len || !want) ? len : -EFAULT;
+}
+
+/**
+ * dma_proxy_release - close() syscall implementation
+ *
+ * @inodep: Unused
+ * @filep: A pointer to a representation of the open file descriptor
+ *
+ * This function removes all of the process-specific resources, i.e.
+ * the dma_proxy_inst held for it and does a little bit of cleanup.
+ *
+ * This function currently always returns zero.
+ */
+static int dma_proxy_release(struct inode *inodep, struct file *filep) {
+    int i;
+
+    printk(KERN_INFO "dma_proxy: device file release\n");
+
+    // Clean up process-related data and remove private_data
+    if (filep->private_data) {
+        // Find the tracked resource and stop tracking it
+        mutex_lock(&inst_lock);
+        for (i = 0; i < MAX_INST; i++) {
+            if (instances[i] == (struct dma_proxy_inst *)filep->private_data) {
+                instances[i] = NULL;
+                break;
+            }
+        }
+        mutex_unlock(&inst_lock);
+
+        // Hand the hardware back if the process still holds a lease
+        dma_proxy_bypass_leave((struct dma_proxy_inst *)filep->private_data);
+        dma_proxy_lease_release((struct dma_proxy_inst *)filep->private_data);
+
+        // Let pending S2MM transfers into the buffers finish before freeing them
+        dma_proxy_sync((struct dma_proxy_inst *)filep->private_data, false);
+
+        // Free the kernel data buffers for the process if it did not do this by itself
+        release_inst((struct dma_proxy_inst *)filep->private_data);
+    }
+
+    mutex_lock(&inst_lock);
+    if (num_open > 0)
+        num_open--;
+    mutex_unlock(&inst_lock);
+    return 0;
+}
+
+/**
+ * dma_proxy_ioctl - ioctl() syscall implementation
+ *
+ * @filep: A pointer representing the open file descriptor
+ * @cmd: ioctl command code
+ * @arg: Optional argument data that may be part the command
+ *
+ * This function is used to control use of the DMA peripheral.
+ * It provides the following command codes:
+ *  - DMAPROXY_IOCTCBUF: Allocate a cache-coherent kernel buffer to be used for DMA
+ *                       for the calling process. The extra argument specifies the
+ *                       size of the buffer. Note that this may not be larger than
+ *                       the maximum transfer size of the core, see DMAPROXY_IOCTCAPS.
+ *                       The buffer gets handle 0, which is mapped at
+ *                       mmap() offset 0.
+ *  - DMAPROXY_IOCTRBUF: Free a previously allocated buffer with handle 0.
+ *  - DMAPROXY_IOCTSTART: Start a DMA transfer to the peripheral. Data will be taken
+ *                        from the buffer with handle 0. The additional argument
+ *                        specifies the number of bytes from the buffer to transmit.
+ *                        Note that this call blocks until the DMA transfer is complete.
+ *  - DMAPROXY_IOCTBUFNEW: Allocate a buffer with the lowest free handle, see struct
+ *                         dma_proxy_buf_req. Up to MAX_BUFS buffers can be allocated per
+ *                         open file descriptor, each is mapped at DMAPROXY_BUF_OFFSET()
+ *                         of its handle.
+ *  - DMAPROXY_IOCTBUFDEL: Free the buffer with the given handle.
+ *  - DMAPROXY_IOCTXFER: Like DMAPROXY_IOCTSTART, but for the buffer named in struct
+ *                       dma_proxy_xfer.
+ *  - DMAPROXY_IOCTXFEROP: Like DMAPROXY_IOCTXFER, but the data passes through the transform
+ *                         selected in struct dma_proxy_xfer_op. Transforms other than the
+ *                         inversion need a data_xform core.
+ *  - DMAPROXY_IOCTBUFINFO: Describe the buffer with the given handle, see struct
+ *                          dma_proxy_buf_info.
+ *  - DMAPROXY_IOCTBYPASS: Hand the core over to the calling process, which may then map its
+ *                         registers at DMAPROXY_REGS_OFFSET and program transfers itself,
+ *                         using the bus addresses reported by DMAPROXY_IOCTBUFINFO.
+ *                         Requires the allow_bypass module parameter and CAP_SYS_RAWIO,
+ *                         and is only available for cores in simple mode. Other processes
+ *                         are locked out until the file descriptor is closed.
+ *  - DMAPROXY_IOCTCAPS: Describe the core as configured in the device tree, see struct
+ *                       dma_proxy_caps.
+ *  - DMAPROXY_IOCTRXSYNC: This call simply blocks until all DMA transfers from the
+ *                         peripheral back to the buffers of the current file descriptor
+ *                         have finished. Each buffer may have one transfer in flight. It
+ *                         fails with the first error of those transfers since the last call:
+ *                         -ETIMEDOUT if one took longer than xfer_timeout_ms, and -EPROTO,
+ *                         -EREMOTEIO or -EFAULT for internal, slave and decode errors
+ *                         reported by the core, which is reset before the call returns.
+ *  - DMAPROXY_IOCTRXTIMES: Like DMAPROXY_IOCTRXSYNC, and also return the time the transfer
+ *                          started last spent queued, being set up, in MM2S and in S2MM,
+ *                          see struct dma_proxy_xfer_times. The timings are copied out even
+ *                          if the transfer failed.
+ *  - DMAPROXY_IOCTLEASE: Grant the file descriptor exclusive use of the engine for a bounded
+ *                        number of transfers and time, see struct dma_proxy_lease. Other
+ *                        processes block in DMAPROXY_IOCTSTART until the lease has ended.
+ *                        During the lease, the channels are kept in the run state and only
+ *                        their address and length registers are rewritten per transfer.
+ *
+ * This function returns zero in case of success, and an error code otherwise.
+ */
+static long dma_proxy_ioctl(struct file *filep, unsigned int cmd, unsigned long arg) {
+    size_t sz = 0;
+    int err = 0;
+    __u32 handle = 0;
+    struct dma_proxy_inst *instp;
+    struct dma_proxy_lease lease;
+    struct dma_proxy_buf_req req;
+    struct dma_proxy_buf_info info;
+    struct dma_proxy_bypass_info bypass;
+    struct dma_proxy_caps caps;
+    struct dma_proxy_buf *buf;
+    struct dma_proxy_xfer xfer;
+    struct dma_proxy_xfer_op xfer_op;
+    struct dma_proxy_xfer_times times;
+    struct dma_proxy_job *job;
+
+    // Process command
+    switch (cmd) {
+        // Allocate a DMA buffer for the process to use until it no longer requires it
+        case DMAPROXY_IOCTCBUF:
+            // Arg is the kernel buffer size
+            if (arg) {
+                if (copy_from_user(&sz, (void *)arg, sizeof(size_t)))
+                    return -EIO;
+            }
+            else 
+                return -EINVAL;
+
+            if (!filep->private_data)
+                return -EINVAL;
+            instp = (struct dma_proxy_inst *)filep->private_data;
+            mutex_lock(&instp->buf_lock);
+            err = dma_proxy_alloc_buf(instp, 0, sz);
+            mutex_unlock(&instp->buf_lock);
+            return err;
+
+        // Free a previously set up DMA buffer
+        case DMAPROXY_IOCTRBUF:
+            if (!filep->private_data)
+                return -EINVAL;
+            instp = (struct dma_proxy_inst *)filep->private_data;
+            mutex_lock(&instp->buf_lock);
+            err = dma_proxy_free_buf(instp, 0);
+            mutex_unlock(&instp->buf_lock);
+            return err;
+
+        // Start inverting data
+        case DMAPROXY_IOCTSTART:
+            // Arg will be the number of bytes to send
+            if (arg) {
+                if (copy_from_user(&sz, (void *)arg, sizeof(size_t)))
+                    return -EIO;
+            }
+            else 
+                return -EINVAL;
+
+            if (!filep->private_data)
+                return -EINVAL;
+            return dma_proxy_start((struct dma_proxy_inst *)filep->private_data, 0, sz, DMAPROXY_OP_INVERT, 0);
+
+        // Allocate a DMA buffer with the lowest free handle
+        case DMAPROXY_IOCTBUFNEW:
+            if (!arg || !filep->private_data)
+                return -EINVAL;
+            if (copy_from_user(&req, (void *)arg, sizeof(struct dma_proxy_buf_req)))
+                return -EIO;
+            if (req.rsvd || req.size > ip_info.max_xfer)
+                return -EINVAL;
+
+            instp = (struct dma_proxy_inst *)filep->private_data;
+            mutex_lock(&instp->buf_lock);
+            for (handle = 0; handle < MAX_BUFS && instp->bufs[handle].dma_buf_virt; handle++);
+            err = handle < MAX_BUFS ? dma_proxy_alloc_buf(instp, handle, req.size) : -ENOSPC;
+            mutex_unlock(&instp->buf_lock);
+            if (err)
+                return err;
+
+            req.handle = handle;
+            req.offset = DMAPROXY_BUF_OFFSET(handle);
+            if (copy_to_user((void *)arg, &req, sizeof(struct dma_proxy_buf_req))) {
+                mutex_lock(&instp->buf_lock);
+                dma_proxy_free_buf(instp, handle);
+                mutex_unlock(&instp->buf_lock);
+                return -EIO;
+            }
+            break;
+
+        // Free the DMA buffer with the given handle
+        case DMAPROXY_IOCTBUFDEL:
+            if (!arg || !filep->private_data)
+                return -EINVAL;
+            if (copy_from_user(&handle, (void *)arg, sizeof(__u32)))
+                return -EIO;
+
+            instp = (struct dma_proxy_inst *)filep->private_data;
+            mutex_lock(&instp->buf_lock);
+            err = dma_proxy_free_buf(instp, handle);
+            mutex_unlock(&instp->buf_lock);
+            return err;
+
+        // Start inverting data in the given buffer
+        case DMAPROXY_IOCTXFER:
+            if (!arg || !filep->private_data)
+                return -EINVAL;
+            if (copy_from_user(&xfer, (void *)arg, sizeof(struct dma_proxy_xfer)))
+                return -EIO;
+            return dma_proxy_start((struct dma_proxy_inst *)filep->private_data, xfer.handle, xfer.len,
+                                   DMAPROXY_OP_INVERT, 0);
+
+        // Start a transfer of any buffer through one of the transforms
+        case DMAPROXY_IOCTXFEROP:
+            if (!arg || !filep->private_data)
+                return -EINVAL;
+            if (copy_from_user(&xfer_op, (void *)arg, sizeof(struct dma_proxy_xfer_op)))
+                return -EIO;
+            return dma_proxy_start((struct dma_proxy_inst *)filep->private_data, xfer_op.handle, xfer_op.len,
+                                   xfer_op.op, xfer_op.key);
+
+        // Return status about device and the current process' context
+        case DMAPROXY_IOCTRXSYNC:
+            if (filep->private_data) {
+                instp = (struct dma_proxy_inst *)filep->private_data;
+
+                // S2MM completion is signalled by the RX synchronization thread or the dmaengine callback
+                err = dma_proxy_sync(instp, true);
+                return err ? err : xchg(&instp->sync_err, 0);
+            } else
+                return -EINVAL;
+
+            break;
+
+        // Like DMAPROXY_IOCTRXSYNC, and report where the transfer spent its time
+        case DMAPROXY_IOCTRXTIMES:
+            if (!arg || !filep->private_data)
+                return -EINVAL;
+
+            instp = (struct dma_proxy_inst *)filep->private_data;
+            err = dma_proxy_sync(instp, true);
+            if (err)
+                return err;
+
+            // The times are those of the transfer that was started last
+            job = READ_ONCE(instp->last_job);
+            memset(&times, 0, sizeof(times));
+            if (job) {
+                times.queue_ns = dma_proxy_phase_ns(job, DMA_PROXY_TS_SUBMIT, DMA_PROXY_TS_START);
+                times.setup_ns = dma_proxy_phase_ns(job, DMA_PROXY_TS_START, DMA_PROXY_TS_ARM);
+                times.mm2s_ns = dma_proxy_phase_ns(job, DMA_PROXY_TS_ARM, DMA_PROXY_TS_MM2S);
+                times.s2mm_ns = dma_proxy_phase_ns(job, DMA_PROXY_TS_MM2S, DMA_PROXY_TS_S2MM);
+                times.err = job->err;
+            }
+            times.flags = ip_info.ts_addr ? DMAPROXY_CAP_PLTIME : 0;
+            if (copy_to_user((void *)arg, &times, sizeof(struct dma_proxy_xfer_times)))
+                return -EIO;
+            return xchg(&instp->sync_err, 0);
+
+        // Describe a DMA buffer, including its bus address for processes in bypass mode
+        case DMAPROXY_IOCTBUFINFO:
+            if (!arg || !filep->private_data)
+                return -EINVAL;
+            if (copy_from_user(&info, (void *)arg, sizeof(struct dma_proxy_buf_info)))
+                return -EIO;
+            if (info.rsvd)
+                return -EINVAL;
+
+            instp = (struct dma_proxy_inst *)filep->private_data;
+            mutex_lock(&instp->buf_lock);
+            buf = dma_proxy_get_buf(instp, info.handle);
+            if (buf) {
+                info.size = buf->buf_sz;
+                info.offset = DMAPROXY_BUF_OFFSET(info.handle);
+                info.dma_addr = instp->bypass ? buf->dma_buf_phys : 0;
+            }
+            mutex_unlock(&instp->buf_lock);
+            if (!buf)
+                return -EINVAL;
+            if (copy_to_user((void *)arg, &info, sizeof(struct dma_proxy_buf_info)))
+                return -EIO;
+            break;
+
+        // Hand the core over to the calling process
+        case DMAPROXY_IOCTBYPASS:
+            if (!arg || !filep->private_data)
+                return -EINVAL;
+            if (!allow_bypass || !capable(CAP_SYS_RAWIO))
+                return -EPERM;
+            if (ip_info.backend != DMA_PROXY_BACKEND_REGS || ip_info.dma.ops != &axi_dma_simple_ops)
+                return -EOPNOTSUPP;
+
+            instp = (struct dma_proxy_inst *)filep->private_data;
+            if (!instp->bypass) {
+                err = dma_proxy_bypass_enter(instp);
+                if (err)
+                    return err;
+            }
+
+            bypass.regs_offset = DMAPROXY_REGS_OFFSET;
+            bypass.regs_size = ip_info.remap_sz;
+            bypass.addr_width = ip_info.addr_width;
+            if (copy_to_user((void *)arg, &bypass, sizeof(struct dma_proxy_bypass_info)))
+                return -EIO;
+            break;
+
+        // Describe the core as configured in the device tree
+        case DMAPROXY_IOCTCAPS:
+            if (!arg)
+                return -EINVAL;
+
+            caps.max_xfer = ip_info.max_xfer;
+            caps.addr_width = ip_info.addr_width;
+            caps.data_width = ip_info.data_width;
+            caps.align = ip_info.xfer_align;
+            caps.flags = 0;
+            if (ip_info.has_sg)
+                caps.flags |= DMAPROXY_CAP_SG;
+            if (ip_info.backend == DMA_PROXY_BACKEND_ENGINE)
+                caps.flags |= DMAPROXY_CAP_ENGINE;
+            else if (ip_info.dma.ops == &axi_dma_model_ops)
+                caps.flags |= DMAPROXY_CAP_MODEL;
+            if (dma_proxy_has_xform())
+                caps.flags |= DMAPROXY_CAP_XFORM;
+            if (ip_info.ts_addr)
+                caps.flags |= DMAPROXY_CAP_PLTIME;
+            if (copy_to_user((void *)arg, &caps, sizeof(struct dma_proxy_caps)))
+                return -EIO;
+            break;
+
+        // Acquire or release an exclusive lease on the hardware
+        case DMAPROXY_IOCTLEASE:
+            if (!arg || !filep->private_data)
+                return -EINVAL;
+            if (copy_from_user(&lease, (void *)arg, sizeof(struct dma_proxy_lease)))
+                return -EIO;
+
+            instp = (struct dma_proxy_inst *)filep->private_data;
+            if (instp->bypass)
+                return -EBUSY;
+            if (!lease.max_jobs && !lease.max_ms) {
+                dma_proxy_lease_release(instp);
+                break;
+            }
+            if (!lease.max_jobs || lease.max_jobs > MAX_LEASE_JOBS || !lease.max_ms || lease.max_ms > MAX_LEASE_MS)
+                return -EINVAL;
+            return dma_proxy_lease_acquire(instp, lease.max_jobs, lease.max_ms, false);
+
+        default:
+            return -EINVAL;
+    }
+
+    return 0;
+}
+
+/**
+ * dma_proxy_mmap - mmap() syscall implementation
+ *
+ * @filep: A pointer to a representation of the open file descriptor
+ * @vma: A vm_area_struct pointer containing details about the region to map to
+ *
+ * This mmap handler is used to map kernel buffers into user-space. The buffer is selected
+ * by the offset of the mapping, see DMAPROXY_BUF_OFFSET(). Offsets within a buffer
+ * are allowed as long as they are page aligned. In bypass mode, the register window of
+ * the core can be mapped at DMAPROXY_REGS_OFFSET as well.
+ *
+ * This function return zero in case of success, and an error code otherwise.
+ */
+static int dma_proxy_mmap(struct file *filep, struct vm_area_struct *vma) {
+    unsigned long req_sz = 0;
+    unsigned long offset = 0;
+    struct dma_proxy_inst *instp = NULL;
+    struct dma_proxy_buf *buf = NULL;
+    int err = 0;
+
+    // Get the requested size and make sure it is not bigger than the internal buffer
+    req_sz = vma->vm_end - vma->vm_start;
+    if (!filep->private_data)
+        return -EFAULT;
+                
+    instp = (struct dma_proxy_inst *)filep->private_data;
+    if (vma->vm_pgoff == (DMAPROXY_REGS_OFFSET >> PAGE_SHIFT)) {
+        if (!instp->bypass)
+            return -EPERM;
+        if (req_sz > PAGE_ALIGN(ip_info.remap_sz))
+            return -EINVAL;
+
+        vma->vm_page_prot = pgprot_noncached(vma->vm_page_prot);
+        return io_remap_pfn_range(vma, vma->vm_start, ip_info.res->start >> PAGE_SHIFT, req_sz, vma->vm_page_prot);
+    }
+
+    offset = (vma->vm_pgoff << PAGE_SHIFT) & (DMAPROXY_BUF_OFFSET(1) - 1);
+    mutex_lock(&instp->buf_lock);
+    buf = dma_proxy_get_buf(instp, vma->vm_pgoff >> (DMAPROXY_BUF_SHIFT - PAGE_SHIFT));
+    if (!buf || offset >= buf->buf_sz || req_sz > buf->buf_sz - offset) {
+        mutex_unlock(&instp->buf_lock);
+        return -EINVAL;
+    }
+
+    // Let the DMA API pick the mapping and its attributes, it takes the offset within the buffer from vm_pgoff
+    vma->vm_pgoff = offset >> PAGE_SHIFT;
+    err = dma_mmap_coherent(ip_info.dma_dev, vma, buf->dma_buf_virt, buf->dma_buf_phys, buf->buf_sz);
+    mutex_unlock(&instp->buf_lock);
+    return err;
+}
+
+
+#ifdef DMA_PROXY_HAS_URING_CMD
+/************************************************************************************
+* io_uring passthrough functions
+************************************************************************************/
+
+/**
+ * dma_proxy_xfer_sync - Run a complete transfer from the calling context
+ *
+ * @job: The transfer
+ * @buf: The buffer that is transferred
+ * @sz: Number of bytes to transfer
+ * @op: Transform applied to the data
+ * @key: Key of the transform
+ *
+ * This function blocks until both the MM2S and the S2MM transfer have completed.
+ * Unlike DMAPROXY_IOCTSTART, no RX synchronization thread is involved.
+ *
+ * This function returns zero in case of success, and an error code otherwise.
+ */
+static int dma_proxy_xfer_sync(struct dma_proxy_job *job, struct dma_proxy_buf *buf, size_t sz,
+                               uint32_t op, uint32_t key) {
+    int err = 0;
+    bool leased = false;
+
+    if (ip_info.backend == DMA_PROXY_BACKEND_ENGINE) {
+        err = dma_proxy_start_engine(job, buf, sz, op, key);
+        if (!err)
+            err = dma_proxy_wait_done(job, &job->rx_done, false);
+        return err ? err : job->err;
+    }
+
+    err = dma_proxy_acquire_hw(job, sz, &leased);
+    if (err)
+        return err;
+
+    err = dma_proxy_arm_regs(job, buf, sz, op, key, leased);
+    if (!err) {
+        err = axi_dma_sync_tx(&ip_info.dma);
+        if (!err) {
+            dma_proxy_stamp(job, DMA_PROXY_TS_MM2S);
+            err = axi_dma_poll_rx(&ip_info.dma);
+        }
+        if (!err)
+            dma_proxy_stamp(job, DMA_PROXY_TS_S2MM);
+        else
+            dma_proxy_recover(job->instp, err);
+    }
+    dma_proxy_xfer_done(job, err);
+    mutex_unlock(&ip_info.hw_lock);
+    return err;
+}
+
+/**
+ * dma_proxy_uring_done - Post the completion of an io_uring job
+ *
+ * @ioucmd: The command of the job
+ * @issue_flags: io_uring flags of the task work context
+ *
+ * This function runs as task work of the submitting task, as requested by the dispatcher.
+ */
+static void dma_proxy_uring_done(struct io_uring_cmd *ioucmd, unsigned int issue_flags) {
+    struct dma_proxy_uring_job *job = *(struct dma_proxy_uring_job **)ioucmd->pdu;
+
+    atomic_dec(&job->buf->pending);
+    io_uring_cmd_done(ioucmd, job->res, 0, issue_flags);
+    kfree(job);
+}
+
+/**
+ * dma_proxy_uring_worker - Dispatch queued io_uring jobs to the hardware
+ *
+ * @data: Unused
+ *
+ * This function is run as a kernel thread for the lifetime of the device. It takes jobs
+ * off the queue in submission order, runs them and posts their completions. Jobs that are
+ * still queued when the thread is stopped are completed with -ECANCELED.
+ *
+ * This function always returns zero.
+ */
+static int dma_proxy_uring_worker(void *data) {
+    struct dma_proxy_uring_job *job;
+
+    while (!kthread_should_stop()) {
+        wait_event_interruptible(uring_wq, !list_empty(&uring_jobs) || kthread_should_stop());
+
+        spin_lock(&uring_lock);
+        job = list_first_entry_or_null(&uring_jobs, struct dma_proxy_uring_job, node);
+        if (job) {
+            list_del(&job->node);
+            atomic_dec(&ip_info.uring_depth);
+        }
+        spin_unlock(&uring_lock);
+        if (!job)
+            continue;
+
+        job->res = dma_proxy_xfer_sync(&job->xfer, job->buf, job->sz, job->op, job->key);
+        if (!job->res)
+            job->res = job->sz;
+        io_uring_cmd_complete_in_task(job->ioucmd, dma_proxy_uring_done);
+    }
+
+    // Flush whatever was submitted after the last dispatch
+    spin_lock(&uring_lock);
+    while ((job = list_first_entry_or_null(&uring_jobs, struct dma_proxy_uring_job, node))) {
+        list_del(&job->node);
+        atomic_dec(&ip_info.uring_depth);
+        job->res = -ECANCELED;
+        io_uring_cmd_complete_in_task(job->ioucmd, dma_proxy_uring_done);
+    }
+    spin_unlock(&uring_lock);
+    return 0;
+}
+
+/**
+ * dma_proxy_uring_start - Start the io_uring job dispatcher
+ *
+ * This function return zero in case of success, and an error code otherwise.
+ */
+static int dma_proxy_uring_start(void) {
+    uring_thread = dma_proxy_completion_run(dma_proxy_uring_worker, NULL, "dma_proxy_uring");
+    if (IS_ERR(uring_thread)) {
+        int err = PTR_ERR(uring_thread);
+        uring_thread = NULL;
+        return err;
+    }
+
+    return 0;
+}
+
+/**
+ * dma_proxy_uring_stop - Stop the io_uring job dispatcher
+ */
+static void dma_proxy_uring_stop(void) {
+    struct task_struct *task;
+
+    // The completion settings are applied to the thread from sysfs, hide it before it goes away.
+    // It must not be stopped with the lock held, as the transfers it dispatches take it too.
+    mutex_lock(&completion_lock);
+    task = uring_thread;
+    uring_thread = NULL;
+    mutex_unlock(&completion_lock);
+    if (task)
+        kthread_stop(task);
+}
+
+/**
+ * dma_proxy_uring_cmd - io_uring passthrough (IORING_OP_URING_CMD) implementation
+ *
+ * @ioucmd: The passthrough command
+ * @issue_flags: io_uring flags of the issuing context
+ *
+ * This function provides the following command codes (cmd_op of the SQE):
+ *  - DMAPROXY_URING_XFER: Transfer the given number of bytes from a buffer of the file
+ *                         descriptor through the peripheral and back into the buffer.
+ *                         The payload is a struct dma_proxy_uring_sqe, which also selects
+ *                         the transform applied to the data. The CQE is posted once
+ *                         the S2MM transfer has completed and carries the number of bytes
+ *                         transferred.
+ * Commands are queued and never wait for the hardware, which also makes them usable from an
+ * SQPOLL thread. When issued with IO_URING_F_NONBLOCK, the command does not sleep on memory
+ * or on the buffer table either, and returns -EAGAIN so that io_uring retries it from a
+ * worker if it would have to. Buffers are named by handle and stay pinned until they are removed, which
+ * is refused while commands referencing them are queued. So nothing is mapped per command.
+ *
+ * This function returns -EIOCBQUEUED if the command was queued, and an error code otherwise.
+ */
+static int dma_proxy_uring_cmd(struct io_uring_cmd *ioucmd, unsigned int issue_flags) {
+    const struct dma_proxy_uring_sqe *cmd = io_uring_sqe_cmd(ioucmd->sqe);
+    struct dma_proxy_inst *instp = ioucmd->file->private_data;
+    bool nonblock = issue_flags & IO_URING_F_NONBLOCK;
+    struct dma_proxy_uring_job *job;
+    struct dma_proxy_buf *buf;
+    size_t sz;
+    uint32_t handle, op, key;
+    int err;
+
+    if (ioucmd->cmd_op != DMAPROXY_URING_XFER)
+        return -ENOTTY;
+
+    job = kzalloc(sizeof(struct dma_proxy_uring_job), nonblock ? GFP_NOWAIT : GFP_KERNEL);
+    if (!job)
+        return nonblock ? -EAGAIN : -ENOMEM;
+
+    // The SQE is shared with user space, so every field is read only once.
+    // The buffer is pinned under the table lock, so that it cannot be removed while queued.
+    sz = READ_ONCE(cmd->len);
+    handle = READ_ONCE(cmd->handle);
+    op = READ_ONCE(cmd->op);
+    key = READ_ONCE(cmd->key);
+    err = dma_proxy_check_op(op, key, sz);
+    if (err) {
+        kfree(job);
+        return err;
+    }
+    if (!nonblock)
+        mutex_lock(&instp->buf_lock);
+    else if (!mutex_trylock(&instp->buf_lock)) {
+        kfree(job);
+        return -EAGAIN;
+    }
+    buf = dma_proxy_get_buf(instp, handle);
+    if (!buf || !sz || sz > buf->buf_sz || sz > ip_info.max_xfer) {
+        mutex_unlock(&instp->buf_lock);
+        kfree(job);
+        return -EINVAL;
+    }
+    atomic_inc(&buf->pending);
+    mutex_unlock(&instp->buf_lock);
+    trace_dma_proxy_submit(instp, handle, sz, op, key);
+
+    dma_proxy_job_init(&job->xfer, instp, false);
+    job->buf = buf;
+    job->ioucmd = ioucmd;
+    job->sz = sz;
+    job->op = op;
+    job->key = key;
+    *(struct dma_proxy_uring_job **)ioucmd->pdu = job;
+
+    spin_lock(&uring_lock);
+    list_add_tail(&job->node, &uring_jobs);
+    atomic_inc(&ip_info.uring_depth);
+    spin_unlock(&uring_lock);
+    wake_up_interruptible(&uring_wq);
+    return -EIOCBQUEUED;
+}
+#else
+static inline int dma_proxy_uring_start(void) { return 0; }
+static inline void dma_proxy_uring_stop(void) { }
+#endif
+
+
+/************************************************************************************
+* Statistics in sysfs, below /sys/class/dmaprx/dma_proxy/stats
+************************************************************************************/
+
+// Define a read-only attribute that prints one counter of the device statistics
+#define DMA_PROXY_STATS_ATTR(name)                                                          \
+    static ssize_t name##_show(struct device *dev, struct device_attribute *attr, char *buf) { \
+        return sysfs_emit(buf, "%lld\n", (long long)atomic64_read(&ip_info.stats.name));   \
+    }                                                                                       \
+    static DEVICE_ATTR_RO(name)
+
+DMA_PROXY_STATS_ATTR(xfers);
+DMA_PROXY_STATS_ATTR(bytes);
+DMA_PROXY_STATS_ATTR(errors);
+DMA_PROXY_STATS_ATTR(wait_ns);
+DMA_PROXY_STATS_ATTR(busy_ns);
+DMA_PROXY_STATS_ATTR(recoveries);
+DMA_PROXY_STATS_ATTR(recovery_ns);
+DMA_PROXY_STATS_ATTR(recovery_max_ns);
+
+// Latency histogram of the device, see dma_proxy_stats_done()
+static ssize_t latency_hist_show(struct device *dev, struct device_attribute *attr, char *buf) {
+    return dma_proxy_stats_show_hist(&ip_info.stats, buf);
+}
+static DEVICE_ATTR_RO(latency_hist);
+
+// Transfers waiting for the hardware, including io_uring jobs not yet dispatched
+static ssize_t queue_depth_show(struct device *dev, struct device_attribute *attr, char *buf) {
+    return sysfs_emit(buf, "%d\n", atomic_read(&ip_info.hw_waiters) + atomic_read(&ip_info.uring_depth));
+}
+static DEVICE_ATTR_RO(queue_depth);
+
+// One line per open file descriptor, the command name last as it may contain spaces:
+// slot pid xfers bytes errors wait_ns busy_ns comm
+static ssize_t clients_show(struct device *dev, struct device_attribute *attr, char *buf) {
+    struct dma_proxy_inst *instp;
+    ssize_t len = 0;
+    int i;
+
+    mutex_lock(&inst_lock);
+    for (i = 0; instances && i < MAX_INST; i++) {
+        instp = instances[i];
+        if (!instp)
+            continue;
+        len += scnprintf(buf + len, PAGE_SIZE - len, "%d %d %lld %lld %lld %lld %lld %s\n", i, instp->pid,
+                         (long long)atomic64_read(&instp->stats.xfers), (long long)atomic64_read(&instp->stats.bytes),
+                         (long long)atomic64_read(&instp->stats.errors), (long long)atomic64_read(&instp->stats.wait_ns),
+                         (long long)atomic64_read(&instp->stats.busy_ns), instp->comm);
+    }
+    mutex_unlock(&inst_lock);
+    return len;
+}
+static DEVICE_ATTR_RO(clients);
+
+static struct attribute *dma_proxy_stats_attrs[] = {
+    &dev_attr_xfers.attr,
+    &dev_attr_bytes.attr,
+    &dev_attr_errors.attr,
+    &dev_attr_wait_ns.attr,
+    &dev_attr_busy_ns.attr,
+    &dev_attr_recoveries.attr,
+    &dev_attr_recovery_ns.attr,
+    &dev_attr_recovery_max_ns.attr,
+    &dev_attr_latency_hist.attr,
+    &dev_attr_queue_depth.attr,
+    &dev_attr_clients.attr,
+    NULL
+};
+
+static const struct attribute_group dma_proxy_stats_group = {
+    .name = "stats",
+    .attrs = dma_proxy_stats_attrs,
+};
+
+
+
+/************************************************************************************
+* Completion path placement in sysfs, below /sys/class/dmaprx/dma_proxy/completion
+************************************************************************************/
+
+/**
+ * dma_proxy_completion_update - Apply changed completion settings to the running device
+ *
+ * Threads started for single transfers pick the settings up when they are started.
+ * This function must be called with completion_lock held.
+ *
+ * This function return zero in case of success, and an error code otherwise.
+ */
+static int dma_proxy_completion_update(void) {
+    int err = 0;
+
+#ifdef DMA_PROXY_HAS_URING_CMD
+    if (uring_thread)
+        err = dma_proxy_completion_task(uring_thread);
+#endif
+    dma_proxy_completion_irqs(completion_cpu >= 0 ? cpumask_of(completion_cpu) : cpu_possible_mask);
+    return err;
+}
+
+/**
+ * dma_proxy_completion_store - Change one of the completion settings from sysfs
+ *
+ * @setting: The completion_* parameter to change
+ * @buf: The value written
+ * @count: Number of bytes written
+ *
+ * Switching between the normal and the real-time policies resets the priority to
+ * a default of the new policy if it is out of range for it.
+ *
+ * This function returns @count in case of success, and an error code otherwise.
+ */
+static ssize_t dma_proxy_completion_store(int *setting, const char *buf, size_t count) {
+    int old_cpu, old_policy, old_prio;
+    int val, err;
+
+    err = kstrtoint(buf, 0, &val);
+    if (err)
+        return err;
+
+    mutex_lock(&completion_lock);
+    old_cpu = completion_cpu;
+    old_policy = completion_policy;
+    old_prio = completion_prio;
+
+    *setting = val;
+    if (setting == &completion_policy && dma_proxy_completion_check(-1, completion_policy, completion_prio))
+        completion_prio = completion_policy == SCHED_NORMAL ? 0 : MAX_RT_PRIO / 2;
+
+    err = dma_proxy_completion_check(completion_cpu, completion_policy, completion_prio);
+    if (!err)
+        err = dma_proxy_completion_update();
+
+    // Keep what was running before
+    if (err) {
+        completion_cpu = old_cpu;
+        completion_policy = old_policy;
+        completion_prio = old_prio;
+        dma_proxy_completion_update();
+    }
+    mutex_unlock(&completion_lock);
+    return err ? err : count;
+}
+
+// Define a read-write attribute for one of the completion settings
+#define DMA_PROXY_COMPLETION_ATTR(name)                                                                     \
+    static ssize_t completion_##name##_show(struct device *dev, struct device_attribute *attr, char *buf) { \
+        return sysfs_emit(buf, "%d\n", READ_ONCE(completion_##name));                                      \
+    }                                                                                                       \
+    static ssize_t completion_##name##_store(struct device *dev, struct device_attribute *attr,             \
+                                             const char *buf, size_t count) {                               \
+        return dma_proxy_completion_store(&completion_##name, buf, count);                                  \
+    }                                                                                                       \
+    static struct device_attribute dev_attr_completion_##name =                                             \
+        __ATTR(name, 0644, completion_##name##_show, completion_##name##_store)
+
+DMA_PROXY_COMPLETION_ATTR(cpu);
+DMA_PROXY_COMPLETION_ATTR(policy);
+DMA_PROXY_COMPLETION_ATTR(prio);
+
+static struct attribute *dma_proxy_completion_attrs[] = {
+    &dev_attr_completion_cpu.attr,
+    &dev_attr_completion_policy.attr,
+    &dev_attr_completion_prio.attr,
+    NULL
+};
+
+static const struct attribute_group dma_proxy_completion_group = {
+    .name = "completion",
+    .attrs = dma_proxy_completion_attrs,
+};
+
+static const struct attribute_group *dma_proxy_groups[] = {
+    &dma_proxy_stats_group,
+    &dma_proxy_completion_group,
+    NULL
+};
+
+
+/************************************************************************************
+* Platform driver specific functions
+************************************************************************************/
+
+/**
+ * dma_proxy_parse_core - Read the configuration of the AXI DMA core from the device tree
+ *
+ * @np: Device tree node of the core
+ *
+ * This function reads the address width, the width of the buffer length registers and
+ * the presence of the SG engine from the node of the core, and the stream data width,
+ * realignment engine and interrupt of each channel from its child nodes. Properties
+ * that are missing default to the configuration of the original bitstream.
+ *
+ * This function return zero in case of success, and an error code otherwise.
+ */
+static int dma_proxy_parse_core(struct device_node *np) {
+    struct device_node *child;
+    uint32_t len_width, width;
+    bool dre = true;
+    int *irqp;
+    int irq;
+
+    if (of_property_read_u32(np, "xlnx,addrwidth", &ip_info.addr_width))
+        ip_info.addr_width = AXI_DMA_MIN_ADDR_W;
+    if (ip_info.addr_width < AXI_DMA_MIN_ADDR_W || ip_info.addr_width > AXI_DMA_MAX_ADDR_W) {
+        dev_err(&ip_info.ofdev->dev, "Unsupported address width %u\n", ip_info.addr_width);
+        return -EINVAL;
+    }
+
+    // The length registers bound both the size of a transfer and of the buffers for it
+    if (of_property_read_u32(np, "xlnx,sg-length-width", &len_width))
+        len_width = AXI_DMA_DEF_LEN_W;
+    if (len_width < AXI_DMA_MIN_LEN_W || len_width > AXI_DMA_MAX_LEN_W) {
+        dev_err(&ip_info.ofdev->dev, "Unsupported buffer length width %u\n", len_width);
+        return -EINVAL;
+    }
+    ip_info.max_xfer = (((size_t)1) << len_width) - 1;
+    ip_info.has_sg = of_property_read_bool(np, "xlnx,include-sg");
+
+    ip_info.data_width = 0;
+    ip_info.tx_irq = 0;
+    ip_info.rx_irq = 0;
+    for_each_child_of_node(np, child) {
+        if (of_device_is_compatible(child, "xlnx,axi-dma-mm2s-channel"))
+            irqp = &ip_info.tx_irq;
+        else if (of_device_is_compatible(child, "xlnx,axi-dma-s2mm-channel"))
+            irqp = &ip_info.rx_irq;
+        else
+            continue;
+
+        if (of_property_read_u32(child, "xlnx,datawidth", &width))
+            width = AXI_DMA_DEF_DATA_W;
+        if (width < AXI_DMA_MIN_DATA_W || width > AXI_DMA_MAX_DATA_W || !is_power_of_2(width)) {
+            dev_err(&ip_info.ofdev->dev, "Unsupported stream data width %u\n", width);
+            of_node_put(child);
+            return -EINVAL;
+        }
+        ip_info.data_width = max(ip_info.data_width, width);
+        dre = dre && of_property_read_bool(child, "xlnx,include-dre");
+
+        irq = of_irq_get(child, 0);
+        if (irq == -EPROBE_DEFER) {
+            of_node_put(child);
+            return irq;
+        }
+        *irqp = irq > 0 ? irq : 0;
+    }
+
+    // Nodes without channel descriptions are treated like the original bitstream
+    if (!ip_info.data_width) {
+        ip_info.data_width = AXI_DMA_DEF_DATA_W;
+        dre = false;
+    }
+    ip_info.xfer_align = dre ? 1 : ip_info.data_width / 8;
 
-    kzfree(instances);
+    dev_info(&ip_info.ofdev->dev, "%u-bit addresses, %u-bit streams, transfers of up to %zu bytes%s\n",
+             ip_info.addr_width, ip_info.data_width, ip_info.max_xfer, ip_info.has_sg ? ", SG" : "");
+    return 0;
 }
 
-/************************************************************************************
-* File operation functions
-************************************************************************************/
-
 /**
- * dma_proxy_open - open() syscall implementation
+ * dma_proxy_setup_dma - Select the implementation that drives the core and reset it
  *
- * @inodep: Unused
- * @filep: A pointer to a struct file, corresponding to the file descriptor received by the
- *         calling process
+ * @devp: Platform device pointer of the bound node
+ * @ops: The implementation, simple or SG mode, or the software model
  *
- * This function implements the open() syscall for the driver.
- * It allocates a dma_proxy_inst for the process and stores it in the private data.
+ * Builds that are specialized for a single implementation (see AXI_DMA_BACKEND in the
+ * Makefile) refuse devices that need another one.
  *
- * This function returns zero on success, and an error code otherwise.
+ * This function return zero in case of success, and an error code otherwise.
  */
-static int dma_proxy_open(struct inode *inodep, struct file *filep) {
-    struct dma_proxy_inst *instp;
-    int i;
-
-    if (num_open < MAX_INST)
-        printk(KERN_INFO "dma_proxy: device file opened\n");
-    else
-        return -EBUSY;
-
-    // Allocate private data for process
-    instp = kzalloc(sizeof(struct dma_proxy_inst), GFP_KERNEL);
-    if (!instp)
-        return -ENOMEM;
+static int dma_proxy_setup_dma(struct platform_device *devp, const struct axi_dma_ops *ops) {
+    int err = 0;
 
-    // Initialize instance
-    instp->dma_buf_phys = 0;
-    instp->dma_buf_virt = NULL;
-    instp->buf_sz = 0;
-    mutex_init(&instp->rx_lock);
+#ifdef AXI_DMA_FIXED_BACKEND
+    if (ops != &axi_dma_fixed_ops) {
+        dev_err(&ip_info.ofdev->dev, "Core needs the %s backend, but the driver was built for %s only\n",
+                ops->name, axi_dma_fixed_ops.name);
+        return -ENODEV;
+    }
+#endif
 
-    filep->private_data = instp;
+    ip_info.dma.ops = ops;
+    ip_info.dma.addr_width = ip_info.addr_width;
+    ip_info.dma_dev = &devp->dev;
+    err = axi_dma_call(&ip_info.dma, init, ip_info.dma_dev);
+    if (err)
+        return err;
 
-    // Track resources
-    for (i = 0; i < MAX_INST; i++) {
-        if (instances[i] == NULL) {
-            instances[i] = instp;
-            break;
-        }
+    // Setup the AXI DMA channels (i.s. reset and halt)
+    err = axi_dma_call(&ip_info.dma, reset);
+    if (!err)
+        err = axi_dma_call(&ip_info.dma, halt);
+    if (err) {
+        axi_dma_call(&ip_info.dma, release, ip_info.dma_dev);
+        return err;
     }
-    
-    num_open++;
+
+    dev_info(&ip_info.ofdev->dev, "Driving the core in %s mode\n", ops->name);
+    ip_info.backend = DMA_PROXY_BACKEND_REGS;
     return 0;
 }
 
 /**
- * dma_proxy_read - read() syscall implementation
+ * dma_proxy_setup_regs - Set up the backend that programs the core directly
  *
- * @filep: Unused
- * @buf: Unused
- * @len: Unused
- * @offsetp: Unused
+ * @devp: Platform device pointer of the AXI DMA core
  *
- * This function is currently not implemented.
+ * This function maps the registers of the core into kernel space, sets the DMA mask
+ * according to the address width of the core and resets the channels. Cores with
+ * an SG engine are driven in SG mode, all others in simple mode.
  *
- * This function currently always returns zero.
+ * This function return zero in case of success, and an error code otherwise.
  */
-static ssize_t dma_proxy_read(struct file *filep, char *buf, size_t len, loff_t *offsetp) {
-    printk(KERN_INFO "dma_proxy: device file read\n");
+static int dma_proxy_setup_regs(struct platform_device *devp) {
+    int err = 0;
+
+    // Get resource information for device
+    ip_info.res = platform_get_resource(devp, IORESOURCE_MEM, 0);
+    if (!ip_info.res ) {
+        dev_err(&ip_info.ofdev->dev, "No memory resource information available\n");
+        return -ENODEV;
+    }
+
+    err = dma_proxy_parse_core(devp->dev.of_node);
+    if (err)
+        return err;
+
+    // Restrict DMA allocations to what the core can reach, so that buffers anywhere
+    // in that range are used directly without bounce buffering
+    err = dma_set_mask_and_coherent(&devp->dev, DMA_BIT_MASK(ip_info.addr_width));
+    if (err) {
+        dev_err(&ip_info.ofdev->dev, "Could not set a %u-bit DMA mask\n", ip_info.addr_width);
+        return err;
+    }
+
+    // Get memory size for ioremap and request memory region for mapping
+    ip_info.remap_sz = ip_info.res->end - ip_info.res->start + 1; 
+    if (!request_mem_region(ip_info.res->start, ip_info.remap_sz, devp->name)) {
+        dev_err(&ip_info.ofdev->dev, "Could not setup memory region for remap\n");
+        return -ENXIO;
+    }
+
+    // Map the physical MMIO space of the core to virtual kernel space memory
+    ip_info.dma.base_addr = ioremap(ip_info.res->start, ip_info.remap_sz);
+    if (ip_info.dma.base_addr == NULL) {
+        dev_err(&ip_info.ofdev->dev, "Could not ioremap MMIO at 0x%08lx\n", (unsigned long)ip_info.res->start);
+        err = -ENOMEM;
+        goto err_ioremap;
+    }
+
+    err = dma_proxy_setup_dma(devp, ip_info.has_sg ? &axi_dma_sg_ops : &axi_dma_simple_ops);
+    if (err)
+        goto err_reset;
     return 0;
+
+err_reset:
+    iounmap(ip_info.dma.base_addr);
+    ip_info.dma.base_addr = NULL;
+err_ioremap:
+    release_mem_region(ip_info.res->start, ip_info.remap_sz);
+    return err;
 }
 
 /**
- * dma_proxy_write - write() syscall implementation
+ * dma_proxy_setup_model - Set up the software model of the core
  *
- * @filep: Unused
- * @buf: Unused
- * @len: Unused
- * @offsetp: Unused
+ * @devp: Platform device pointer of the model node
  *
- * This function is currently not implemented.
+ * The model has no registers. The node may carry the same properties as the node
+ * of a core, to model its limits.
  *
- * This function currently always returns zero.
+ * This function return zero in case of success, and an error code otherwise.
  */
-static ssize_t dma_proxy_write(struct file *filep, const char *buf, size_t len, loff_t *offsetp) {
-    printk(KERN_INFO "dma_proxy: device file write\n");
-    return 0;
+static int dma_proxy_setup_model(struct platform_device *devp) {
+    int err = 0;
+
+    err = dma_proxy_parse_core(devp->dev.of_node);
+    if (err)
+        return err;
+
+    err = dma_set_mask_and_coherent(&devp->dev, DMA_BIT_MASK(ip_info.addr_width));
+    if (err) {
+        dev_err(&ip_info.ofdev->dev, "Could not set a %u-bit DMA mask\n", ip_info.addr_width);
+        return err;
+    }
+
+    ip_info.res = NULL;
+    ip_info.remap_sz = 0;
+    ip_info.dma.base_addr = NULL;
+    ip_info.dma.xform_op = AXI_XFORM_OP_INVERT;
+    ip_info.dma.xform_key = 0;
+    return dma_proxy_setup_dma(devp, &axi_dma_model_ops);
 }
 
 /**
- * dma_proxy_release - close() syscall implementation
+ * dma_proxy_setup_engine - Set up the backend that acts as a dmaengine client
  *
- * @inodep: Unused
- * @filep: A pointer to a representation of the open file descriptor
+ * @devp: Platform device pointer of the client node
  *
- * This function removes all of the process-specific resources, i.e.
- * the dma_proxy_inst held for it and does a little bit of cleanup.
+ * This function requests the MM2S and S2MM channels listed in the client node.
+ * Buffers are allocated for the provider device, as that is what performs the DMA,
+ * and the limits of the core are read from the node of the provider. Builds that are
+ * specialized for one of the register backends refuse the client node as well.
  *
- * This function currently always returns zero.
+ * This function return zero in case of success, and an error code otherwise.
  */
-static int dma_proxy_release(struct inode *inodep, struct file *filep) {
-    int i;
+static int dma_proxy_setup_engine(struct platform_device *devp) {
+    int err = 0;
 
-    printk(KERN_INFO "dma_proxy: device file release\n");
+#ifdef AXI_DMA_FIXED_BACKEND
+    dev_err(&ip_info.ofdev->dev, "Node needs the dmaengine backend, but the driver was built for %s only\n",
+            axi_dma_fixed_ops.name);
+    return -ENODEV;
+#endif
 
-    // Clean up process-related data and remove private_data
-    if (filep->private_data) {
-        // Find the tracked resource and stop tracking it
-        for (i = 0; i < MAX_INST; i++) {
-            if (instances[i] == (struct dma_proxy_inst *)filep->private_data) {
-                instances[i] = NULL;
-                break;
-            }
-        }
+    err = axi_dma_engine_request(&devp->dev, &ip_info.tx_chan, &ip_info.rx_chan);
+    if (err) {
+        if (err != -EPROBE_DEFER)
+            dev_err(&ip_info.ofdev->dev, "Could not request dmaengine channels\n");
+        return err;
+    }
 
-        // Free the kernel data buffer for the process if it did not do this by itself
-        release_inst((struct dma_proxy_inst *)filep->private_data);
+    // The channels belong to the core, whose node describes its configuration
+    ip_info.dma_dev = ip_info.tx_chan->device->dev;
+    err = dma_proxy_parse_core(ip_info.dma_dev->of_node);
+    if (err) {
+        axi_dma_engine_release(ip_info.tx_chan, ip_info.rx_chan);
+        return err;
     }
 
-    if (num_open > 0)
-        num_open--;
+    ip_info.backend = DMA_PROXY_BACKEND_ENGINE;
     return 0;
 }
 
 /**
- * dma_proxy_ioctl - ioctl() syscall implementation
+ * dma_proxy_release_backend - Undo the setup of the backend
+ */
+static void dma_proxy_release_backend(void) {
+    if (ip_info.backend == DMA_PROXY_BACKEND_ENGINE) {
+        mutex_lock(&completion_lock);
+        dma_proxy_completion_irqs(NULL);
+        mutex_unlock(&completion_lock);
+        axi_dma_engine_release(ip_info.tx_chan, ip_info.rx_chan);
+        ip_info.tx_chan = NULL;
+        ip_info.rx_chan = NULL;
+        return;
+    }
+
+    axi_dma_call(&ip_info.dma, halt);
+    axi_dma_call(&ip_info.dma, release, ip_info.dma_dev);
+    if (ip_info.dma.base_addr) {
+        iounmap(ip_info.dma.base_addr);
+        release_mem_region(ip_info.res->start, ip_info.remap_sz);
+        ip_info.dma.base_addr = NULL;
+    }
+}
+
+/**
+ * dma_proxy_setup_xform - Map the data_xform core that selects the stream transform
  *
- * @filep: A pointer representing the open file descriptor
- * @cmd: ioctl command code
- * @arg: Optional argument data that may be part the command
+ * @devp: Platform device pointer of the bound node
  *
- * This function is used to control use of the DMA peripheral.
- * It provides the following command codes:
- *  - DMAPROXY_IOCTCBUF: Allocate a cache-coherent kernel buffer to be used for DMA
- *                       for the calling process. The extra argument specifies the
- *                       size of the buffer. Note that this may not be larger than
- *                       MAX_BUF_SZ. Note also that only one buffer is allowed per
- *                       open file descriptor.
- *  - DMAPROXY_IOCTRBUF: Free a previously allocated buffer.
- *  - DMAPROXY_IOCTSTART: Start a DMA transfer to the peripheral. Data will be taken
- *                        from the buffer corresponding to the file descriptor. The
- *                        additional argument specifies the number of bytes from the
- *                        buffer to transmit. Note that this call blocks until the
- *                        DMA transfer is complete.
- *  - DMAPROXY_IOCTRXSYNC: This call simply blocks until a currently active DMA transfer
- *                         from the peripheral back to the buffer corresponding to the
- *                         current file descriptor has finished.
+ * The data_xform core is optional and referenced from the bound node through the
+ * "fuzzylogic,xform-ctrl" phandle. Without it, the stream core is assumed to be data_inv,
+ * which only inverts.
  *
- * This function returns zero in case of success, and an error code otherwise.
+ * This function return zero in case of success, and an error code otherwise.
  */
-static long dma_proxy_ioctl(struct file *filep, unsigned int cmd, unsigned long arg) {
-    size_t sz = 0;
-    struct dma_proxy_inst *instp;
+static int dma_proxy_setup_xform(struct platform_device *devp) {
+    struct device_node *np;
     int err = 0;
-    struct rx_sync_dat *sync;
-
-    // Process command
-    switch (cmd) {
-        // Allocate a DMA buffer for the process to use until it no longer requires it
-        case DMAPROXY_IOCTCBUF:
-            // Arg is the kernel buffer size
-            if (arg) {
-                if (copy_from_user(&sz, (void *)arg, sizeof(size_t)))
-                    return -EIO;
-            }
-            else 
-                return -EINVAL;
-
-            if (filep->private_data && sz < MAX_BUF_SZ) {
-                // Check if buffer already allocated
-                instp = (struct dma_proxy_inst *)filep->private_data;
-                if (instp->dma_buf_virt)
-                    return -EINVAL;
-                else {
-                    instp->dma_buf_virt = dma_alloc_coherent(&ip_info.ofdev->dev, sz, &instp->dma_buf_phys, GFP_KERNEL);
-                    if (IS_ERR(instp->dma_buf_virt))
-                        return PTR_ERR(instp->dma_buf_virt);
-                    instp->buf_sz = sz;
-                }
-            } else
-                return -EINVAL;
-            break;
-
-        // Free a previously set up DMA buffer
-        case DMAPROXY_IOCTRBUF:
-            // Simply free the buffer
-            if (filep->private_data) {
-                // Check if buffer already allocated
-                instp = (struct dma_proxy_inst *)filep->private_data;
-                if (instp->dma_buf_virt)
-                    dma_free_coherent(&ip_info.ofdev->dev, instp->buf_sz, instp->dma_buf_virt, instp->dma_buf_phys);
-                else
-                    return -EFAULT;
-            } else
-                return -EINVAL;
-            break;
 
-        // Start inverting data
-        case DMAPROXY_IOCTSTART:
-            // Arg will be the number of bytes to send
-            if (arg) {
-                if (copy_from_user(&sz, (void *)arg, sizeof(size_t)))
-                    return -EIO;
-            }
-            else 
-                return -EINVAL;
+    ip_info.xform_addr = NULL;
+    ip_info.xform_op = DMAPROXY_OP_INVERT;
+    ip_info.xform_key = 0;
+    np = of_parse_phandle(devp->dev.of_node, "fuzzylogic,xform-ctrl", 0);
+    if (!np)
+        return 0;
 
-            if (filep->private_data && sz < MAX_BUF_SZ) {
-                // Check if buffer already allocated and that sz is not greater than the buffer length
-                instp = (struct dma_proxy_inst *)filep->private_data;
-                if (!instp->dma_buf_phys || !instp->dma_buf_virt)
-                    return -EINVAL;
-                else if (sz > instp->buf_sz)
-                    return -EINVAL;
-                else {
-                    // Try to acquire hardware, block if necessary...
-                    // Note that if acquired, the mutex will be freed by the rx synchronization thread
-                    mutex_lock(&ip_info.hw_lock);
-
-                    // Setup a transfer to slave
-                    err = axi_dma_setup_tx(ip_info.base_addr, instp->dma_buf_phys);
-                    if (err) {
-                        mutex_lock(&ip_info.hw_lock);
-                        return err;
-                    }
-                    
-                    // Setup the receive channel accordingly
-                    err = axi_dma_setup_rx(ip_info.base_addr, instp->dma_buf_phys, sz);
-                    if (err) {
-                        mutex_lock(&ip_info.hw_lock);
-                        return err;
-                    }
-
-                    // Initiate the transfer
-                    err = axi_dma_start_tx(ip_info.base_addr, sz);
-                    if (err) {
-                        mutex_lock(&ip_info.hw_lock);
-                        return err;
-                    }
-
-                    // Synchronize TX, this will block until the MM2S transfer is complete
-                    axi_dma_sync_tx(ip_info.base_addr);
-
-                    // Start a kernel thread that will synchronize the RX channel and release the hardware
-                    sync = (struct rx_sync_dat*)kzalloc(sizeof(struct rx_sync_dat), GFP_KERNEL);
-                    sync->hw_lock = &ip_info.hw_lock;
-                    sync->instp = instp;
-                    sync->axi_addr = ip_info.base_addr;
-                    sync_rx_thread = kthread_run(axi_dma_sync_rx, sync, "dma_proxy_sync");
-                    if (IS_ERR(sync_rx_thread)) {
-                        mutex_unlock(&ip_info.hw_lock);
-                        return PTR_ERR(sync_rx_thread);
-                    }
-                }
-            } else
-                return -EINVAL;
-            break;
+    err = of_address_to_resource(np, 0, &ip_info.xform_res);
+    of_node_put(np);
+    if (err) {
+        dev_err(&ip_info.ofdev->dev, "No memory resource information available for the transform core\n");
+        return err;
+    }
 
-        // Return status about device and the current process' context
-        case DMAPROXY_IOCTRXSYNC:
-            if (filep->private_data) {
-                // Wait until the S2MM lock is no longer used by the RX synchronization thread
-                instp = (struct dma_proxy_inst *)filep->private_data;
-                mutex_lock(&instp->rx_lock);
-                mutex_unlock(&instp->rx_lock);    
+    if (!request_mem_region(ip_info.xform_res.start, resource_size(&ip_info.xform_res), devp->name)) {
+        dev_err(&ip_info.ofdev->dev, "Could not setup memory region of the transform core\n");
+        return -ENXIO;
+    }
+    ip_info.xform_addr = ioremap(ip_info.xform_res.start, resource_size(&ip_info.xform_res));
+    if (!ip_info.xform_addr) {
+        err = -ENOMEM;
+        goto err_ioremap;
+    }
 
-                // Stop the thread
-                kthread_stop(sync_rx_thread);
-                sync_rx_thread = NULL;            
-            } else
-                return -EINVAL;
+    err = axi_xform_probe(ip_info.xform_addr);
+    if (err) {
+        dev_err(&ip_info.ofdev->dev, "No data_xform core at 0x%08lx\n", (unsigned long)ip_info.xform_res.start);
+        goto err_probe;
+    }
+    return 0;
 
-            break;
+err_probe:
+    iounmap(ip_info.xform_addr);
+    ip_info.xform_addr = NULL;
+err_ioremap:
+    release_mem_region(ip_info.xform_res.start, resource_size(&ip_info.xform_res));
+    return err;
+}
 
-        default:
-            return -EINVAL;
-    }
+/**
+ * dma_proxy_release_xform - Undo dma_proxy_setup_xform()
+ */
+static void dma_proxy_release_xform(void) {
+    if (!ip_info.xform_addr)
+        return;
 
-    return 0;
+    iounmap(ip_info.xform_addr);
+    release_mem_region(ip_info.xform_res.start, resource_size(&ip_info.xform_res));
+    ip_info.xform_addr = NULL;
 }
 
 /**
- * dma_proxy_mmap - mmap() syscall implementation
+ * dma_proxy_setup_ts - Map the PL counter that the phases of transfers are timestamped with
  *
- * @filep: A pointer to a representation of the open file descriptor
- * @vma: A vm_area_struct pointer containing details about the region to map to
+ * @devp: Platform device pointer of the bound node
  *
- * This mmap handler is used to map kernel buffers into user-space.
+ * The counter is optional and referenced from the bound node through the
+ * "fuzzylogic,timestamp-counter" phandle. Its node gives the address of a free-running
+ * 64-bit counter, lower half first, and its rate in "clock-frequency". Without it, the
+ * phases are timestamped with the kernel clock.
  *
  * This function return zero in case of success, and an error code otherwise.
  */
-static int dma_proxy_mmap(struct file *filep, struct vm_area_struct *vma) {
-    int req_sz = 0;
-    struct dma_proxy_inst *instp = NULL;
+static int dma_proxy_setup_ts(struct platform_device *devp) {
+    struct device_node *np;
+    int err = 0;
 
-    // Get the requested size and make sure it is not bigger than the internal buffer
-    req_sz = vma->vm_end - vma->vm_start;
-    if (!filep->private_data)
-        return -EFAULT;
-                
-    instp = (struct dma_proxy_inst *)filep->private_data;
-    if (req_sz > instp->buf_sz)
-        return -EINVAL;
+    ip_info.ts_addr = NULL;
+    np = of_parse_phandle(devp->dev.of_node, "fuzzylogic,timestamp-counter", 0);
+    if (!np)
+        return 0;
+
+    err = of_address_to_resource(np, 0, &ip_info.ts_res);
+    if (!err && (of_property_read_u32(np, "clock-frequency", &ip_info.ts_freq) || !ip_info.ts_freq))
+        err = -EINVAL;
+    of_node_put(np);
+    if (err) {
+        dev_err(&ip_info.ofdev->dev, "Invalid description of the timestamp counter\n");
+        return err;
+    }
+
+    if (!request_mem_region(ip_info.ts_res.start, resource_size(&ip_info.ts_res), devp->name)) {
+        dev_err(&ip_info.ofdev->dev, "Could not setup memory region of the timestamp counter\n");
+        return -ENXIO;
+    }
+    ip_info.ts_addr = ioremap(ip_info.ts_res.start, resource_size(&ip_info.ts_res));
+    if (!ip_info.ts_addr) {
+        release_mem_region(ip_info.ts_res.start, resource_size(&ip_info.ts_res));
+        return -ENOMEM;
+    }
 
-    // Mark the prot value as uncacheable
-    vma->vm_page_prot = pgprot_noncached(vma->vm_page_prot);
-    return remap_pfn_range(vma, vma->vm_start, virt_to_pfn(instp->dma_buf_virt), req_sz, vma->vm_page_prot);
+    dev_info(&ip_info.ofdev->dev, "Timestamping transfers with a %u Hz PL counter\n", ip_info.ts_freq);
+    return 0;
 }
 
+/**
+ * dma_proxy_release_ts - Undo dma_proxy_setup_ts()
+ */
+static void dma_proxy_release_ts(void) {
+    if (!ip_info.ts_addr)
+        return;
 
-/************************************************************************************
-* Platform driver specific functions
-************************************************************************************/
+    iounmap(ip_info.ts_addr);
+    release_mem_region(ip_info.ts_res.start, resource_size(&ip_info.ts_res));
+    ip_info.ts_addr = NULL;
+}
 
 /**
  * dma_proxy_probe- The driver probe function
@@ -366,38 +2456,55 @@ static int dma_proxy_mmap(struct file *filep, struct vm_area_struct *vma) {
  * @devp: Platform device pointer
  *
  * This function is in charge of setting up the driver, which includes setting
- * up the device file, mapping the DMA controller memory to the driver,
- * as well as resetting the DMA core.
+ * up the device file and the backend used to drive the DMA controller.
+ * If the device tree node lists dmaengine channels ("dma-names"), the driver acts as
+ * a client of the dmaengine provider of those channels. A "fuzzylogic,dma-proxy-model"
+ * node selects the software model. Otherwise, the node describes the AXI DMA core
+ * itself, which is then mapped into the driver and reset.
+ * The driver state is global and backs a single device file, so only the first matching
+ * node is bound, the others are refused with -EBUSY.
  *
  * This function return zero in case of success, and an error code otherwise.
  */
 static int dma_proxy_probe(struct platform_device *devp) {
     int err = 0;
 
-    // Get resource information for device
-    ip_info.ofdev = devp; 
-    ip_info.res = platform_get_resource(devp, IORESOURCE_MEM, 0);
-    if (!ip_info.res ) {
-        dev_err(&ip_info.ofdev->dev, "No memory resource information available\n");
-        err = -ENODEV;
-        goto res_err;
+    if (ip_info.ofdev) {
+        dev_err(&devp->dev, "Only one core is supported, already bound to %s\n", dev_name(&ip_info.ofdev->dev));
+        return -EBUSY;
     }
-
-    // Get memory size for ioremap and request memory region for mapping
-    ip_info.remap_sz = ip_info.res->end - ip_info.res->start + 1; 
-    if (!request_mem_region(ip_info.res->start, ip_info.remap_sz, devp->name)) {
-        dev_err(&ip_info.ofdev->dev, "Could not setup memory region for remap\n");
-        err = -ENXIO;
-        goto mem_err;
+    if (dma_proxy_completion_check(completion_cpu, completion_policy, completion_prio)) {
+        dev_err(&devp->dev, "Invalid completion_cpu, completion_policy or completion_prio\n");
+        return -EINVAL;
     }
 
-    // Map the physical MMIO space of the core to virtual kernel space memory
-    ip_info.base_addr = ioremap(ip_info.res->start, ip_info.remap_sz);
-    if (ip_info.base_addr == NULL) {
-        dev_err(&ip_info.ofdev->dev, "Could not ioremap MMIO at 0x%08lx\n", (unsigned long)ip_info.res->start);
-        err = -ENOMEM;
-        goto err_ioremap;
+    ip_info.ofdev = devp;
+
+    if (of_find_property(devp->dev.of_node, "dma-names", NULL))
+        err = dma_proxy_setup_engine(devp);
+    else if (of_device_is_compatible(devp->dev.of_node, "fuzzylogic,dma-proxy-model"))
+        err = dma_proxy_setup_model(devp);
+    else
+        err = dma_proxy_setup_regs(devp);
+    if (err)
+        goto err_backend;
+
+    // Only move the interrupts of the provider if asked to
+    if (completion_cpu >= 0) {
+        mutex_lock(&completion_lock);
+        dma_proxy_completion_irqs(cpumask_of(completion_cpu));
+        mutex_unlock(&completion_lock);
     }
+
+    // Find the core that selects the stream transform, if the design has one
+    err = dma_proxy_setup_xform(devp);
+    if (err)
+        goto err_xform;
+
+    // Find the counter that transfers are timestamped with, if the design has one
+    err = dma_proxy_setup_ts(devp);
+    if (err)
+        goto err_ts;
  
     // Try to dynamically allocate a major number for the device
     major_number = register_chrdev(0, DEVICE_NAME, &fops);
@@ -416,7 +2523,8 @@ static int dma_proxy_probe(struct platform_device *devp) {
     }
     
     // Register the device driver
-    dev_entry = device_create(dma_proxy_class, NULL, MKDEV(major_number, 0), NULL, DEVICE_NAME);
+    dev_entry = device_create_with_groups(dma_proxy_class, NULL, MKDEV(major_number, 0), NULL,
+                                          dma_proxy_groups, DEVICE_NAME);
     if (IS_ERR(dev_entry)){
      dev_err(&ip_info.ofdev->dev, "Failed to register device driver\n");
         err = PTR_ERR(dev_entry);
@@ -431,34 +2539,39 @@ static int dma_proxy_probe(struct platform_device *devp) {
         goto err_inst_setup;
     }
 
-    // Setup the AXI DMA channels (i.s. reset and halt)
-    err = axi_dma_reset(ip_info.base_addr);
-    if (err)
-        goto err_inst_setup;
-    err = axi_dma_halt(ip_info.base_addr);
-    if (err)
-        goto err_inst_setup;
-
-    // Set up a mutex to arbitrate access to the hardware
+    // Set up a mutex to arbitrate access to the hardware, and the state of leases on it
     mutex_init(&ip_info.hw_lock);
+    atomic_set(&ip_info.hw_waiters, 0);
+    atomic_set(&ip_info.uring_depth, 0);
+    spin_lock_init(&ip_info.lease_lock);
+    init_waitqueue_head(&ip_info.lease_wq);
+    ip_info.armed = false;
+
+    // Start dispatching transfers submitted through io_uring
+    err = dma_proxy_uring_start();
+    if (err) {
+        dev_err(&ip_info.ofdev->dev, "Failed to start io_uring dispatcher\n");
+        goto err_uring;
+    }
     goto done;
 
 // Handle errors, revert previous steps
+err_uring:
+    kzfree(instances);
 err_inst_setup:
     device_destroy(dma_proxy_class, MKDEV(major_number, 0)); 
-    class_unregister(dma_proxy_class);                     
-    class_destroy(dma_proxy_class);                        
-    unregister_chrdev(major_number, DEVICE_NAME);
 err_dev:
     class_destroy(dma_proxy_class);
 err_class:
     unregister_chrdev(major_number, DEVICE_NAME);
 err_chrdev:
-    iounmap(ip_info.base_addr);
-err_ioremap:
-    release_mem_region(ip_info.res->start, ip_info.remap_sz);
-mem_err:
-res_err:
+    dma_proxy_release_ts();
+err_ts:
+    dma_proxy_release_xform();
+err_xform:
+    dma_proxy_release_backend();
+err_backend:
+    ip_info.ofdev = NULL;
     return err;
 
 // All steps successful, driver is ready
@@ -476,13 +2589,16 @@ done:
  * Currently this function always returns zero.
  */
 static int dma_proxy_remove(struct platform_device *devp) {
+    dma_proxy_uring_stop();
     release_all_resources();
     device_destroy(dma_proxy_class, MKDEV(major_number, 0)); 
     class_unregister(dma_proxy_class);                     
     class_destroy(dma_proxy_class);                        
     unregister_chrdev(major_number, DEVICE_NAME);        
-    iounmap(ip_info.base_addr);
-    release_mem_region(ip_info.res->start, ip_info.remap_sz);
+    dma_proxy_release_ts();
+    dma_proxy_release_xform();
+    dma_proxy_release_backend();
+    ip_info.ofdev = NULL;
     return 0;
 }
 
@@ -497,7 +2613,9 @@ static void dma_proxy_shutdown(struct platform_device *devp) {
 
 // Table used to match this driver with an entry in the device tree
 static const struct of_device_id dma_proxy_of_match[] = {
-    {.compatible = "xlnx,axi-dma-1.00.a"},
+    {.compatible = "xlnx,axi-dma-1.00.a"},      // The core itself, driven through its registers
+    {.compatible = "fuzzylogic,dma-proxy"},     // A dmaengine client node referencing the core's channels
+    {.compatible = "fuzzylogic,dma-proxy-model"},   // The software model of the core, without hardware
     {}
 };
 
@@ -2,12 +2,18 @@
 #define __DMA_PROXY_DRIVER_H_
 
 #include <linux/fs.h>               // struct file_operations
+#include <linux/uio.h>              // struct iov_iter
+#include <linux/splice.h>           // splice() support via iov_iter
 #include <linux/device.h>           // device related data structures
 #include <linux/kernel.h>           // kernel data structures
 #include <linux/ioctl.h>            // Macros for ioctl command code definitions
 #include <linux/mutex.h>            // For locking the RX channel of a single instance
 #include <linux/platform_device.h>  // struct platform_device
+#include <linux/list.h>             // Queue of io_uring passthrough jobs
+#include <linux/spinlock.h>         // Protecting the io_uring job queue
+#include <linux/wait.h>             // Waking up the io_uring job dispatcher
 #include "types.h"
+#include "compat.h"
 
 
 /************************************************************************************
@@ -17,16 +23,135 @@
 #define DEVICE_NAME         "dma_proxy"
 #define CLASS_NAME          "dmaprx"
 #define MAX_INST            4               // Maximum number of simultaneous "opens" on the device
-#define MAX_BUF_SZ          8192            // Maximum number of bytes in a DMA buffer
-#define AXI_DMA_BASE_ADDR   0x40400000      // DMA core AXI-Lite interface base address
-#define AXI_DMA_ADDR_SZ     0xFFFF          // Address space for AXI-Lite interface
+#define MAX_LEASE_JOBS      4096            // Maximum number of transfers covered by a single lease
+#define MAX_LEASE_MS        1000            // Maximum duration of a single lease in milliseconds
+#define AXI_DMA_MIN_ADDR_W  32              // Default and minimum memory-mapped address width of the core
+#define AXI_DMA_MAX_ADDR_W  64              // Maximum memory-mapped address width of the core
+#define AXI_DMA_DEF_LEN_W   14              // Default width of the buffer length registers (xlnx,sg-length-width)
+#define AXI_DMA_MIN_LEN_W   8               // Minimum width of the buffer length registers
+#define AXI_DMA_MAX_LEN_W   26              // Maximum width of the buffer length registers
+#define AXI_DMA_DEF_DATA_W  32              // Default stream data width of a channel (xlnx,datawidth)
+#define AXI_DMA_MIN_DATA_W  8               // Minimum stream data width of a channel
+#define AXI_DMA_MAX_DATA_W  1024            // Maximum stream data width of a channel
 
 // ioctl command codes
 #define DMAPROXY_IOCTMAGIC  0x89                                // Magic number
-#define DMAPROXY_IOCTCBUF   _IOW(DMAPROXY_IOCTMAGIC, 0, size_t) // Create a kernel DMA buffer for the process 
-#define DMAPROXY_IOCTRBUF   _IO(DMAPROXY_IOCTMAGIC, 1)          // Remove kernel DMA buffer for process
-#define DMAPROXY_IOCTSTART  _IOW(DMAPROXY_IOCTMAGIC, 2, size_t) // Set up and start a DMA transfer to invert data
-#define DMAPROXY_IOCTRXSYNC _IO(DMAPROXY_IOCTMAGIC, 4)          // Block until the process-specific RX lock is released
+#define DMAPROXY_IOCTCBUF   _IOW(DMAPROXY_IOCTMAGIC, 0, size_t) // Create the kernel DMA buffer with handle 0 for the process 
+#define DMAPROXY_IOCTRBUF   _IO(DMAPROXY_IOCTMAGIC, 1)          // Remove the kernel DMA buffer with handle 0 for process
+#define DMAPROXY_IOCTSTART  _IOW(DMAPROXY_IOCTMAGIC, 2, size_t) // Set up and start a DMA transfer to invert data in buffer 0
+#define DMAPROXY_IOCTRXSYNC _IO(DMAPROXY_IOCTMAGIC, 4)          // Block until the transfers of the file descriptor have completed
+#define DMAPROXY_IOCTLEASE  _IOW(DMAPROXY_IOCTMAGIC, 6, struct dma_proxy_lease) // Acquire or release exclusive use of the engine
+
+// Argument of DMAPROXY_IOCTLEASE. The lease ends after max_jobs transfers or max_ms milliseconds,
+// whichever comes first. Passing zero for both releases a lease held by the file descriptor.
+struct dma_proxy_lease {
+    __u32   max_jobs;   // Number of transfers covered by the lease, at most MAX_LEASE_JOBS
+    __u32   max_ms;     // Duration of the lease in milliseconds, at most MAX_LEASE_MS
+};
+#define DMAPROXY_IOCTBUFNEW _IOWR(DMAPROXY_IOCTMAGIC, 7, struct dma_proxy_buf_req) // Create a DMA buffer with a free handle
+#define DMAPROXY_IOCTBUFDEL _IOW(DMAPROXY_IOCTMAGIC, 8, __u32)  // Remove the DMA buffer with the given handle
+#define DMAPROXY_IOCTXFER   _IOW(DMAPROXY_IOCTMAGIC, 9, struct dma_proxy_xfer)   // Like DMAPROXY_IOCTSTART for any buffer
+
+#define DMAPROXY_IOCTBUFINFO _IOWR(DMAPROXY_IOCTMAGIC, 10, struct dma_proxy_buf_info)  // Describe a DMA buffer
+#define DMAPROXY_IOCTBYPASS _IOR(DMAPROXY_IOCTMAGIC, 11, struct dma_proxy_bypass_info) // Take over the core from user space
+#define DMAPROXY_IOCTCAPS   _IOR(DMAPROXY_IOCTMAGIC, 12, struct dma_proxy_caps)  // Describe the capabilities of the core
+#define DMAPROXY_IOCTXFEROP _IOW(DMAPROXY_IOCTMAGIC, 13, struct dma_proxy_xfer_op)  // Like DMAPROXY_IOCTXFER with a transform
+#define DMAPROXY_IOCTRXTIMES _IOR(DMAPROXY_IOCTMAGIC, 14, struct dma_proxy_xfer_times) // Like DMAPROXY_IOCTRXSYNC, with phase timings
+
+// Each buffer of a file descriptor is mapped at the mmap() offset of its handle
+#define DMAPROXY_BUF_SHIFT          26
+#define DMAPROXY_BUF_OFFSET(handle) ((__u64)(handle) << DMAPROXY_BUF_SHIFT)
+
+// In bypass mode, the AXI-Lite register window of the core is mapped at this mmap() offset
+#define DMAPROXY_REGS_OFFSET        DMAPROXY_BUF_OFFSET(MAX_BUFS)
+
+// Argument of DMAPROXY_IOCTBUFNEW
+struct dma_proxy_buf_req {
+    __u64   size;       // In: size of the buffer in bytes, at most dma_proxy_caps.max_xfer
+    __u64   offset;     // Out: mmap() offset of the buffer
+    __u32   handle;     // Out: handle of the buffer
+    __u32   rsvd;       // Reserved, must be zero
+};
+
+// Returned by DMAPROXY_IOCTCAPS, as read from the device tree
+#define DMAPROXY_CAP_SG     (1 << 0)    // The core has a scatter-gather engine
+#define DMAPROXY_CAP_ENGINE (1 << 1)    // The core is driven through the dmaengine backend
+#define DMAPROXY_CAP_XFORM  (1 << 2)    // A data_xform core or the software model selects the transform, see DMAPROXY_OP_*
+#define DMAPROXY_CAP_MODEL  (1 << 3)    // Transfers run on the software model of the core, not on hardware
+#define DMAPROXY_CAP_PLTIME (1 << 4)    // Phase timings are taken from a free-running counter in the PL
+
+struct dma_proxy_caps {
+    __u64   max_xfer;   // Maximum number of bytes in a buffer and in a single transfer
+    __u32   addr_width; // Width of the core's memory-mapped address bus in bits
+    __u32   data_width; // Widest stream data width of the two channels in bits
+    __u32   align;      // Required alignment of buffer addresses in bytes
+    __u32   flags;      // DMAPROXY_CAP_* flags
+};
+
+// Argument of DMAPROXY_IOCTBUFINFO
+struct dma_proxy_buf_info {
+    __u32   handle;     // In: handle of the buffer
+    __u32   rsvd;       // Reserved, must be zero
+    __u64   size;       // Out: size of the buffer in bytes
+    __u64   offset;     // Out: mmap() offset of the buffer
+    __u64   dma_addr;   // Out: bus address of the buffer as seen by the core, only reported in bypass mode
+};
+
+// Returned by DMAPROXY_IOCTBYPASS
+struct dma_proxy_bypass_info {
+    __u64   regs_offset;    // mmap() offset of the register window
+    __u32   regs_size;      // Size of the register window in bytes
+    __u32   addr_width;     // Width of the core's memory-mapped address bus in bits
+};
+
+// Stream transforms selectable per transfer. Without a data_xform core, only the
+// inversion of the data_inv core is available. All other transforms work on 32-bit
+// little-endian words and require a length that is a multiple of four.
+#define DMAPROXY_OP_INVERT  0   // Invert every bit
+#define DMAPROXY_OP_BSWAP   1   // Reverse the byte order of every word
+#define DMAPROXY_OP_XOR     2   // XOR every word with the key
+#define DMAPROXY_OP_CSUM    3   // Replace every word with the XOR of all words up to it,
+                                // so the final word holds the checksum of the transfer
+#define DMAPROXY_NUM_OPS    4
+
+// Argument of DMAPROXY_IOCTXFEROP
+struct dma_proxy_xfer_op {
+    __u32   handle;     // Handle of the buffer
+    __u32   len;        // Number of bytes to transfer from and back into the buffer
+    __u32   op;         // One of DMAPROXY_OP_*
+    __u32   key;        // Key of DMAPROXY_OP_XOR, must be zero for the others
+};
+
+// Returned by DMAPROXY_IOCTRXTIMES, the time the transfer that the file descriptor started last
+// spent in each phase in nanoseconds.
+// Phases that a failed transfer did not reach are zero. The stream core sits between the
+// channels, so its latency is part of s2mm_ns.
+struct dma_proxy_xfer_times {
+    __u64   queue_ns;   // From submission until the hardware was acquired, waiting for other transfers
+    __u64   setup_ns;   // From acquiring the hardware until MM2S was started, e.g. selecting the transform
+    __u64   mm2s_ns;    // From starting MM2S until it had read the buffer into the stream
+    __u64   s2mm_ns;    // From MM2S completion until S2MM had written the result back
+    __s32   err;        // Result of that transfer
+    __u32   flags;      // DMAPROXY_CAP_PLTIME if the PL counter was used, zero for the kernel clock
+};
+
+// Argument of DMAPROXY_IOCTXFER
+struct dma_proxy_xfer {
+    __u32   handle;     // Handle of the buffer to transfer from and back into
+    __u32   len;        // Number of bytes to transfer
+};
+
+// io_uring passthrough (IORING_OP_URING_CMD) command codes, passed in the cmd_op field of the SQE
+#define DMAPROXY_URING_XFER _IOW(DMAPROXY_IOCTMAGIC, 5, struct dma_proxy_uring_sqe) // Full MM2S and S2MM transfer
+
+// Payload of an io_uring passthrough command, stored in the cmd area of the SQE.
+// The CQE of a DMAPROXY_URING_XFER command carries the number of bytes received, or an error code.
+struct dma_proxy_uring_sqe {
+    __u32   len;        // Number of bytes to transfer from and back into the buffer
+    __u32   handle;     // Handle of the buffer
+    __u32   op;         // One of DMAPROXY_OP_*, so zero selects the inversion
+    __u32   key;        // Key of DMAPROXY_OP_XOR, must be zero for the others
+};
 
 
 /************************************************************************************
@@ -37,18 +162,31 @@ static struct class             *dma_proxy_class = NULL;
 static struct device            *dev_entry   = NULL;
 static int                      num_open = 0;
 static struct dma_proxy_inst    **instances = NULL;
-static struct core_info         ip_info = {.base_addr = NULL, .res = NULL, .remap_sz = 0, .ofdev = NULL};
+static DEFINE_MUTEX(inst_lock);                         // Protects num_open and instances
+#ifdef DMA_PROXY_HAS_URING_CMD
+static struct task_struct       *uring_thread = NULL;   // Dispatches queued io_uring jobs to the hardware
+static LIST_HEAD(uring_jobs);                           // io_uring jobs waiting for the hardware
+static DEFINE_SPINLOCK(uring_lock);                     // Protects uring_jobs
+static DECLARE_WAIT_QUEUE_HEAD(uring_wq);               // Wakes up the dispatcher when jobs are queued
+#endif
+static DEFINE_MUTEX(completion_lock);                   // Protects the completion_* parameters
+static LIST_HEAD(engine_jobs);                          // Jobs issued to the dmaengine provider and not completed yet
+static DEFINE_SPINLOCK(engine_lock);                    // Protects engine_jobs, also taken by the provider's callbacks
+static struct core_info         ip_info = {.dma = {.base_addr = NULL}, .res = NULL, .remap_sz = 0, .addr_width = AXI_DMA_MIN_ADDR_W, .ofdev = NULL};
 
 
 /************************************************************************************
 * Function declarations
 ************************************************************************************/
 static int      dma_proxy_open(struct inode *, struct file *);
-static ssize_t  dma_proxy_read(struct file *, char *, size_t, loff_t *);
-static ssize_t  dma_proxy_write(struct file *, const char *, size_t, loff_t *);
+static ssize_t  dma_proxy_read_iter(struct kiocb *, struct iov_iter *);
+static ssize_t  dma_proxy_write_iter(struct kiocb *, struct iov_iter *);
 static int      dma_proxy_release(struct inode *, struct file *);
 static long     dma_proxy_ioctl(struct file *, unsigned int, unsigned long);
 static int      dma_proxy_mmap(struct file *filep, struct vm_area_struct *vma);
+#ifdef DMA_PROXY_HAS_URING_CMD
+static int      dma_proxy_uring_cmd(struct io_uring_cmd *ioucmd, unsigned int issue_flags);
+#endif
 
 
 /************************************************************************************
@@ -57,11 +195,17 @@ static int      dma_proxy_mmap(struct file *filep, struct vm_area_struct *vma);
 static struct file_operations fops =
 {
     .open           = dma_proxy_open,
-    .read           = dma_proxy_read,
-    .write          = dma_proxy_write,
+    .llseek         = default_llseek,
+    .read_iter      = dma_proxy_read_iter,
+    .write_iter     = dma_proxy_write_iter,
+    .splice_read    = generic_file_splice_read,
+    .splice_write   = iter_file_splice_write,
     .release        = dma_proxy_release,
     .unlocked_ioctl = dma_proxy_ioctl,
     .mmap           = dma_proxy_mmap,
+#ifdef DMA_PROXY_HAS_URING_CMD
+    .uring_cmd      = dma_proxy_uring_cmd,
+#endif
 };
 
 #endif // __DMA_PROXY_DRIVER_H_
\ No newline at end of file
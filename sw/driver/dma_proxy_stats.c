@@ -0,0 +1,80 @@
+#include <linux/kernel.h>   // scnprintf
+#include <linux/bitops.h>   // fls64
+#include <linux/mm.h>       // PAGE_SIZE
+#include <linux/math64.h>   // div_u64
+#include "dma_proxy_stats.h"
+
+/**
+ * dma_proxy_stats_wait - Account for the time a transfer waited for the hardware
+ *
+ * @stats: The statistics to update
+ * @wait_ns: Time from submission until the hardware was acquired
+ */
+void dma_proxy_stats_wait(struct dma_proxy_stats *stats, u64 wait_ns) {
+    atomic64_add(wait_ns, &stats->wait_ns);
+}
+
+/**
+ * dma_proxy_stats_done - Account for a transfer that has finished
+ *
+ * @stats: The statistics to update
+ * @sz: Number of bytes transferred
+ * @busy_ns: Time from acquiring the hardware until completion
+ * @lat_ns: Time from submission until completion
+ * @err: Zero if the transfer succeeded, an error code otherwise
+ *
+ * Bucket 0 of the latency histogram counts transfers that took less than 1us, and
+ * bucket i those that took from 2^(i-1) up to 2^i us. The last bucket also counts
+ * everything slower than that. Failed transfers only count as errors.
+ */
+void dma_proxy_stats_done(struct dma_proxy_stats *stats, size_t sz, u64 busy_ns, u64 lat_ns, int err) {
+    int bucket;
+
+    if (err) {
+        atomic64_inc(&stats->errors);
+        return;
+    }
+
+    bucket = min(fls64(div_u64(lat_ns, 1000)), DMA_PROXY_LAT_BUCKETS - 1);
+    atomic64_inc(&stats->xfers);
+    atomic64_add(sz, &stats->bytes);
+    atomic64_add(busy_ns, &stats->busy_ns);
+    atomic64_inc(&stats->lat_hist[bucket]);
+}
+
+/**
+ * dma_proxy_stats_recovery - Account for a reset of the core after a failed transfer
+ *
+ * @stats: The statistics to update
+ * @ns: Time the reset took
+ *
+ * This function must be called with the hardware held, which serializes the updates
+ * of the maximum.
+ */
+void dma_proxy_stats_recovery(struct dma_proxy_stats *stats, u64 ns) {
+    atomic64_inc(&stats->recoveries);
+    atomic64_add(ns, &stats->recovery_ns);
+    if (ns > atomic64_read(&stats->recovery_max_ns))
+        atomic64_set(&stats->recovery_max_ns, ns);
+}
+
+/**
+ * dma_proxy_stats_show_hist - Print the latency histogram for sysfs
+ *
+ * @stats: The statistics to print
+ * @buf: The sysfs page buffer
+ *
+ * The buckets are printed on a single line, separated by spaces.
+ *
+ * This function returns the number of bytes written to buf.
+ */
+ssize_t dma_proxy_stats_show_hist(const struct dma_proxy_stats *stats, char *buf) {
+    ssize_t len = 0;
+    int i;
+
+    for (i = 0; i < DMA_PROXY_LAT_BUCKETS; i++)
+        len += scnprintf(buf + len, PAGE_SIZE - len, "%lld%c", (long long)atomic64_read(&stats->lat_hist[i]),
+                         i == DMA_PROXY_LAT_BUCKETS - 1 ? '\n' : ' ');
+
+    return len;
+}
@@ -0,0 +1,16 @@
+#ifndef __DMA_PROXY_STATS_H_
+#define __DMA_PROXY_STATS_H_
+
+#include <linux/types.h>        // uintX_t and friends
+#include "types.h"
+
+
+/************************************************************************************
+* Statistics function declarations
+************************************************************************************/
+void dma_proxy_stats_wait(struct dma_proxy_stats *stats, u64 wait_ns);
+void dma_proxy_stats_done(struct dma_proxy_stats *stats, size_t sz, u64 busy_ns, u64 lat_ns, int err);
+void dma_proxy_stats_recovery(struct dma_proxy_stats *stats, u64 ns);
+ssize_t dma_proxy_stats_show_hist(const struct dma_proxy_stats *stats, char *buf);
+
+#endif  // __DMA_PROXY_STATS_H_
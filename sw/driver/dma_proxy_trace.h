@@ -0,0 +1,75 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM dma_proxy
+
+#if !defined(__DMA_PROXY_TRACE_H_) || defined(TRACE_HEADER_MULTI_READ)
+#define __DMA_PROXY_TRACE_H_
+
+#include <linux/tracepoint.h>   // TRACE_EVENT
+#include <linux/ktime.h>        // ktime_get_ns
+#include "types.h"
+
+
+/************************************************************************************
+* Tracepoints, below /sys/kernel/tracing/events/dma_proxy
+************************************************************************************/
+
+// A transfer was submitted and is about to wait for the hardware
+TRACE_EVENT(dma_proxy_submit,
+    TP_PROTO(const struct dma_proxy_inst *instp, uint32_t handle, size_t sz, uint32_t op, uint32_t key),
+    TP_ARGS(instp, handle, sz, op, key),
+    TP_STRUCT__entry(
+        __field(u64,    ts)
+        __field(pid_t,  pid)
+        __field(int,    slot)
+        __field(u32,    handle)
+        __field(size_t, size)
+        __field(u32,    op)
+        __field(u32,    key)
+    ),
+    TP_fast_assign(
+        __entry->ts = ktime_get_ns();
+        __entry->pid = instp->pid;
+        __entry->slot = instp->slot;
+        __entry->handle = handle;
+        __entry->size = sz;
+        __entry->op = op;
+        __entry->key = key;
+    ),
+    TP_printk("ts=%llu pid=%d slot=%d handle=%u size=%zu op=%u key=%u", __entry->ts, __entry->pid, __entry->slot,
+              __entry->handle, __entry->size, __entry->op, __entry->key)
+);
+
+// A transfer that acquired the hardware has finished, see dma_proxy_xfer_done().
+// phase_ns holds the queue, setup, MM2S and S2MM times of struct dma_proxy_xfer_times.
+TRACE_EVENT(dma_proxy_done,
+    TP_PROTO(const struct dma_proxy_job *job, u64 lat_ns, int err, const u64 *phase_ns),
+    TP_ARGS(job, lat_ns, err, phase_ns),
+    TP_STRUCT__entry(
+        __field(pid_t,  pid)
+        __field(int,    slot)
+        __field(size_t, size)
+        __field(u64,    lat_ns)
+        __field(int,    err)
+        __array(u64,    phase_ns, 4)
+    ),
+    TP_fast_assign(
+        __entry->pid = job->instp->pid;
+        __entry->slot = job->instp->slot;
+        __entry->size = job->sz;
+        __entry->lat_ns = lat_ns;
+        __entry->err = err;
+        memcpy(__entry->phase_ns, phase_ns, sizeof(__entry->phase_ns));
+    ),
+    TP_printk("pid=%d slot=%d size=%zu lat_ns=%llu err=%d queue_ns=%llu setup_ns=%llu mm2s_ns=%llu s2mm_ns=%llu",
+              __entry->pid, __entry->slot, __entry->size, __entry->lat_ns, __entry->err, __entry->phase_ns[0],
+              __entry->phase_ns[1], __entry->phase_ns[2], __entry->phase_ns[3])
+);
+
+#endif  // __DMA_PROXY_TRACE_H_
+
+// The build passes -I$(src), so that define_trace.h finds this header again
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE dma_proxy_trace
+#include <trace/define_trace.h>
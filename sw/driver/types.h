@@ -1,32 +1,171 @@
 #ifndef __TYPES_H_
 #define __TYPES_H_
 
+#include <linux/mutex.h>        // struct mutex
+#include <linux/completion.h>   // struct completion
+#include <linux/list.h>         // struct list_head
+#include <linux/spinlock.h>     // spinlock_t
+#include <linux/wait.h>         // wait_queue_head_t
+#include <linux/atomic.h>       // atomic_t
+#include <linux/sched.h>        // TASK_COMM_LEN
+
 /************************************************************************************
 * Type declarations
 ************************************************************************************/
 
-// To be stored in private_data of struct file for each process 
-struct dma_proxy_inst {
-    size_t          buf_sz;         // The size of the kernel buffer
+// The mechanism used to drive the AXI DMA core
+enum dma_proxy_backend {
+    DMA_PROXY_BACKEND_REGS,     // This driver drives the core itself through struct axi_dma_ops
+    DMA_PROXY_BACKEND_ENGINE    // The core is driven through a dmaengine provider (e.g. xilinx_dma)
+};
+
+struct axi_dma_ops;
+struct axi_dma_bd;
+
+// A core driven by this driver, as passed to the functions of struct axi_dma_ops
+struct axi_dma {
+    const struct axi_dma_ops *ops;  // Implementation selected at probe time, see axi_dma_call()
+    void            *base_addr;     // Base address of the registers, NULL for the software model
+    uint32_t        addr_width;     // Width of the core's memory-mapped address bus
+    unsigned int    timeout_ms;     // Longest time a channel may take to complete a transfer, zero for no limit
+    struct axi_dma_bd *bds;         // SG mode: descriptor rings of MM2S and S2MM, in coherent memory
+    dma_addr_t      bds_phys;       // SG mode: bus address of the descriptor rings
+    unsigned int    tx_bd;          // SG mode: descriptor of the current MM2S transfer
+    unsigned int    rx_bd;          // SG mode: descriptor of the current S2MM transfer
+    void            *src_virt;      // Software model: source buffer of MM2S
+    void            *dest_virt;     // Software model: destination buffer of S2MM
+    size_t          dest_sz;        // Software model: size of the destination buffer
+    uint32_t        xform_op;       // Software model: transform applied to the stream, see axi_xform_model()
+    uint32_t        xform_key;      // Software model: key of the transform
+    bool            stalled;        // Software model: S2MM of the current transfer never completes
+};
+
+// Phases of a transfer that are timestamped, see dma_proxy_stamp()
+enum dma_proxy_ts {
+    DMA_PROXY_TS_SUBMIT,    // Submitted, before waiting for the hardware
+    DMA_PROXY_TS_START,     // Hardware acquired
+    DMA_PROXY_TS_ARM,       // Core programmed, MM2S about to start
+    DMA_PROXY_TS_MM2S,      // MM2S completed
+    DMA_PROXY_TS_S2MM,      // S2MM completed
+    DMA_PROXY_NUM_TS
+};
+
+struct dma_proxy_inst;
+
+// A transfer, from its submission until its result is signalled through rx_done. Transfers
+// started by ioctl() use the job of their buffer, io_uring transfers bring their own.
+struct dma_proxy_job {
+    struct dma_proxy_inst *instp;   // The instance that submitted the transfer
+    struct list_head node;          // Entry in the list of issued dmaengine jobs
+    bool            rxsync;         // The result is reported by DMAPROXY_IOCTRXSYNC, not in an io_uring CQE
+    struct completion tx_done;      // Signalled by the dmaengine backend once MM2S has completed
+    struct completion rx_done;      // Signalled once S2MM has completed or the transfer has failed
+    int             err;            // Result of the transfer signalled through rx_done
+    size_t          sz;             // Number of bytes it transfers
+    u64             submit;         // Time at which it was submitted, in ns
+    u64             start;          // Time at which it acquired the hardware, in ns
+    u64             ts[DMA_PROXY_NUM_TS];   // Timestamps of its phases, zero until reached
+};
+
+// Maximum number of DMA buffers per open file descriptor
+#define MAX_BUFS    16
+
+// Number of buckets of the latency histogram, see dma_proxy_stats_done()
+#define DMA_PROXY_LAT_BUCKETS   24
+
+// Transfer statistics, kept for the device and for each open file descriptor
+struct dma_proxy_stats {
+    atomic64_t      xfers;          // Transfers that have completed
+    atomic64_t      bytes;          // Bytes passed through the core by those transfers
+    atomic64_t      errors;         // Transfers that failed after they had acquired the hardware
+    atomic64_t      wait_ns;        // Time spent waiting for the hardware
+    atomic64_t      busy_ns;        // Time from acquiring the hardware until completion
+    atomic64_t      lat_hist[DMA_PROXY_LAT_BUCKETS];    // Latency from submission until completion
+    atomic64_t      recoveries;     // Resets of the core after failed transfers, device only
+    atomic64_t      recovery_ns;    // Time spent in those resets, device only
+    atomic64_t      recovery_max_ns;    // Longest of those resets, device only
+};
+
+// A DMA buffer owned by a process, identified by its index in the buffer table of the process
+struct dma_proxy_buf {
+    size_t          buf_sz;         // The size of the kernel buffer, zero if the table entry is unused
     dma_addr_t      dma_buf_phys;   // The physical address that can be used by the DMA controller
     void            *dma_buf_virt;  // The virtual address of the DMA buffer used by the CPU
-    struct mutex    rx_lock;        // Mutex for the S2MM channel, used to test whether receiving has been completed
+    atomic_t        pending;        // Number of queued io_uring transfers referencing the buffer
+    struct dma_proxy_job job;       // Transfer started on the buffer by ioctl(), one at a time
+};
+
+// To be stored in private_data of struct file for each process 
+struct dma_proxy_inst {
+    struct dma_proxy_buf bufs[MAX_BUFS];    // Table of DMA buffers, indexed by handle
+    struct mutex    buf_lock;       // Serializes changes to the buffer table
+    bool            bypass;         // The process programs the core itself, see DMAPROXY_IOCTBYPASS
+    struct dma_proxy_job *last_job; // Transfer started last by ioctl(), NULL before the first one
+    int             sync_err;       // First error of those transfers since the last DMAPROXY_IOCTRXSYNC
+    pid_t           pid;            // Process that opened the file descriptor
+    char            comm[TASK_COMM_LEN];    // Name of that process
+    int             slot;           // Index of the file descriptor in the table of open ones
+    struct dma_proxy_stats stats;   // Statistics of the transfers of this file descriptor
 };
 
 // Information stored about the AXI DMA core
 struct core_info {
-    void                    *base_addr; // Base address of the AXI-DMA core
+    struct axi_dma          dma;        // The core, unless it is driven through dmaengine
     struct resource         *res;       // Kernel resource struct
     unsigned long           remap_sz;   // Size of the MMIO address space mapped to the driver
+    uint32_t                addr_width; // Width of the core's memory-mapped address bus (xlnx,addrwidth)
+    uint32_t                data_width; // Widest stream data width of the channels (xlnx,datawidth)
+    uint32_t                xfer_align; // Required alignment of buffer addresses in bytes
+    size_t                  max_xfer;   // Maximum number of bytes in a transfer (xlnx,sg-length-width)
+    bool                    has_sg;     // The core was built with a scatter-gather engine (xlnx,include-sg)
+    int                     tx_irq;     // Interrupt of the MM2S channel, zero if not wired up
+    int                     rx_irq;     // Interrupt of the S2MM channel, zero if not wired up
+    void                    *xform_addr;    // Base address of the data_xform core, NULL if there is none
+    struct resource         xform_res;      // MMIO resource of the data_xform core
+    uint32_t                xform_op;       // Transform currently selected in the data_xform core
+    uint32_t                xform_key;      // Key currently programmed into the data_xform core
+    void                    *ts_addr;       // Base address of the PL timestamp counter, NULL if there is none
+    struct resource         ts_res;         // MMIO resource of the PL timestamp counter
+    uint32_t                ts_freq;        // Frequency of the PL timestamp counter in Hz
     struct platform_device  *ofdev;     // Kernel platform device
+    struct device           *dma_dev;   // Device that DMA buffers are allocated and mapped for
+    enum dma_proxy_backend  backend;    // How the core is driven
+    struct dma_chan         *tx_chan;   // MM2S channel when using the dmaengine backend
+    struct dma_chan         *rx_chan;   // S2MM channel when using the dmaengine backend
     struct mutex            hw_lock;    // Used to mediate general races on the hardware between processes
+    atomic_t                hw_waiters; // Number of processes currently trying to acquire the hardware
+    spinlock_t              lease_lock; // Protects the lease state below
+    wait_queue_head_t       lease_wq;   // Processes waiting for a lease held by another instance to end
+    struct dma_proxy_inst   *lease_owner;   // Instance holding an exclusive lease, NULL if there is none
+    struct dma_proxy_inst   *lease_prev;    // Previous lease holder, may not take a new lease while others wait
+    unsigned long           lease_expires;  // End of the lease in jiffies
+    uint32_t                lease_jobs;     // Number of transfers left on the lease
+    bool                    lease_bypass;   // The lease is held for user-space access and does not expire
+    uint32_t                lease_seq;      // Number of leases granted so far, identifies the current one
+    bool                    armed;          // Channels are held in the run state for the lease holder, under hw_lock
+    uint32_t                armed_lease;    // lease_seq of the lease the channels were armed for, under hw_lock
+    struct dma_proxy_stats  stats;          // Statistics of all transfers of the device
+    atomic_t                uring_depth;    // Number of io_uring jobs waiting for the dispatcher
+};
+
+// A transfer submitted through io_uring, waiting for or owned by the dispatcher thread
+struct dma_proxy_uring_job {
+    struct list_head        node;           // Entry in the queue of pending jobs
+    struct dma_proxy_job    xfer;           // State of the transfer, including the instance that submitted it
+    struct dma_proxy_buf    *buf;           // The buffer that is transferred
+    struct io_uring_cmd     *ioucmd;        // The command to complete once the transfer has finished
+    size_t                  sz;             // Number of bytes to transfer
+    uint32_t                op;             // Transform applied to the data, one of DMAPROXY_OP_*
+    uint32_t                key;            // Key of the transform
+    int                     res;            // Result posted to the completion queue
 };
 
 // This struct is the information passed to the RX synchronization thread
 struct rx_sync_dat {
     struct mutex            *hw_lock;       // The global hardware mutex, used to protect the AXI-DMA instance from races
-    struct dma_proxy_inst   *instp;         // The process instance
-    void                    *axi_addr;      // Address of the AXI-DMA core
+    struct dma_proxy_job    *job;           // The transfer
+    struct axi_dma          *dma;           // The core that performs the transfer
+    void                    (*complete)(struct dma_proxy_job *job, int err);    // Called once S2MM has completed
 };
 
 #endif
\ No newline at end of file
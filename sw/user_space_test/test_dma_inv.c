@@ -1,9 +1,16 @@
+#define _GNU_SOURCE     // splice
 #include <stdio.h>      // printf
 #include <fcntl.h>      // open
 #include <unistd.h>     // close
 #include <sys/ioctl.h>  // ioctl
 #include <sys/mman.h>   // mmap/munmap
 #include <stdlib.h>     // malloc/free
+#include <string.h>     // memset
+#include <errno.h>      // errno
+#include <time.h>       // clock_gettime
+#ifdef HAVE_LIBURING
+#include <liburing.h>   // io_uring_queue_init/io_uring_submit
+#endif
 #include "test_dma_inv.h"
 
 int main(void) {
@@ -109,4 +116,727 @@ int test_single_inv(void) {
     free(buf_orig);
     close(fd);
     return 0;
-}
\ No newline at end of file
+}
+
+// Run a few inversions back to back while holding a lease on the engine
+int test_lease(void) {
+    int i, j;
+    int fd = open("/dev/dma_proxy", O_RDWR);
+    if (fd < 0)
+        return -1;
+
+    // Create buffer and map it into user-space
+    size_t buf_sz = 4096;
+    if (ioctl(fd, DMAPROXY_IOCTCBUF, &buf_sz))
+        return -1;
+    char *buf = (char *)mmap(NULL, buf_sz, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (buf == MAP_FAILED)
+        return -1;
+
+    // A lease that does not cover anything is rejected
+    struct dma_proxy_lease lease = {0, 100};
+    if (!ioctl(fd, DMAPROXY_IOCTLEASE, &lease))
+        return -1;
+
+    lease.max_jobs = 4;
+    lease.max_ms = 500;
+    if (ioctl(fd, DMAPROXY_IOCTLEASE, &lease))
+        return -1;
+
+    // Every transfer inverts the buffer again, only the first one reprograms DMACR
+    for (i = 0; i < buf_sz; i++)
+        buf[i] = i;
+    for (j = 0; j < 4; j++) {
+        if (ioctl(fd, DMAPROXY_IOCTSTART, &buf_sz) || ioctl(fd, DMAPROXY_IOCTRXSYNC))
+            return -1;
+        for (i = 0; i < buf_sz; i++) {
+            if (buf[i] != (char)(j % 2 ? i : ~i))
+                return -1;
+        }
+    }
+
+    // Release the lease, this is also fine if it already ended with the last transfer
+    lease.max_jobs = 0;
+    lease.max_ms = 0;
+    if (ioctl(fd, DMAPROXY_IOCTLEASE, &lease))
+        return -1;
+
+    munmap(buf, buf_sz);
+    close(fd);
+    return 0;
+}
+
+// Set up several buffers on a single file descriptor and invert each of them
+int test_multi_buf(void) {
+    int i, j;
+    struct dma_proxy_buf_req reqs[3];
+    struct dma_proxy_xfer xfer;
+    char *bufs[3];
+    int fd = open("/dev/dma_proxy", O_RDWR);
+    if (fd < 0)
+        return -1;
+
+    // Each buffer gets its own handle and is mapped at its own offset
+    for (j = 0; j < 3; j++) {
+        reqs[j].size = 1024 * (j + 1);
+        reqs[j].rsvd = 0;
+        if (ioctl(fd, DMAPROXY_IOCTBUFNEW, &reqs[j]))
+            return -1;
+        bufs[j] = (char *)mmap(NULL, reqs[j].size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, reqs[j].offset);
+        if (bufs[j] == MAP_FAILED)
+            return -1;
+        for (i = 0; i < reqs[j].size; i++)
+            bufs[j][i] = i + j;
+    }
+
+    // Invert all buffers, naming them by handle
+    for (j = 0; j < 3; j++) {
+        xfer.handle = reqs[j].handle;
+        xfer.len = reqs[j].size;
+        if (ioctl(fd, DMAPROXY_IOCTXFER, &xfer) || ioctl(fd, DMAPROXY_IOCTRXSYNC))
+            return -1;
+    }
+    for (j = 0; j < 3; j++) {
+        for (i = 0; i < reqs[j].size; i++) {
+            if (bufs[j][i] != (char)~(i + j))
+                return -1;
+        }
+    }
+
+    // Unmap and remove the buffers, removing one twice must fail
+    for (j = 0; j < 3; j++) {
+        munmap(bufs[j], reqs[j].size);
+        if (ioctl(fd, DMAPROXY_IOCTBUFDEL, &reqs[j].handle))
+            return -1;
+    }
+    if (!ioctl(fd, DMAPROXY_IOCTBUFDEL, &reqs[0].handle))
+        return -1;
+
+    close(fd);
+    return 0;
+}
+
+// Feed a buffer from a pipe and drain it into a pipe again, without mapping it
+int test_splice(void) {
+    int i;
+    char data[2048], out[2048];
+    int pipefd[2];
+    loff_t off;
+    int fd = open("/dev/dma_proxy", O_RDWR);
+    if (fd < 0)
+        return -1;
+
+    size_t buf_sz = sizeof(data);
+    if (ioctl(fd, DMAPROXY_IOCTCBUF, &buf_sz) || pipe(pipefd))
+        return -1;
+
+    // Splice data from the pipe into buffer 0
+    for (i = 0; i < sizeof(data); i++)
+        data[i] = 3 * i;
+    if (write(pipefd[1], data, sizeof(data)) != sizeof(data))
+        return -1;
+    off = 0;
+    if (splice(pipefd[0], NULL, fd, &off, sizeof(data), 0) != sizeof(data))
+        return -1;
+
+    // Invert it and splice the result back out
+    if (ioctl(fd, DMAPROXY_IOCTSTART, &buf_sz) || ioctl(fd, DMAPROXY_IOCTRXSYNC))
+        return -1;
+    off = 0;
+    if (splice(fd, &off, pipefd[1], NULL, sizeof(data), 0) != sizeof(data))
+        return -1;
+    memset(out, 0, sizeof(out));
+    if (read(pipefd[0], out, sizeof(out)) != sizeof(out))
+        return -1;
+    for (i = 0; i < sizeof(data); i++) {
+        if (out[i] != (char)~data[i])
+            return -1;
+    }
+
+    close(pipefd[0]);
+    close(pipefd[1]);
+    close(fd);
+    return 0;
+}
+
+
+// Take over the core and invert a buffer by programming the registers directly
+int test_bypass(void) {
+    struct dma_bypass dev;
+    struct dma_bypass_buf buf;
+    size_t buf_sz = 4096;
+    unsigned char *data;
+    unsigned int i;
+    int err;
+
+    // Bypass mode is opt-in, skip the test if the driver does not allow it
+    err = dma_bypass_open(&dev, "/dev/dma_proxy");
+    if (err) {
+        if (err == -EPERM || err == -EOPNOTSUPP) {
+            printf("Bypass mode not available, skipping\n");
+            return 0;
+        }
+        return -1;
+    }
+
+    // The driver no longer starts transfers on this file descriptor
+    if (dma_bypass_buf_new(&dev, &buf, buf_sz) || !buf.dma_addr)
+        return -1;
+    if (!ioctl(dev.fd, DMAPROXY_IOCTSTART, &buf_sz) || errno != EBUSY)
+        return -1;
+
+    data = (unsigned char *)buf.virt;
+    for (i = 0; i < buf_sz; i++)
+        data[i] = i;
+
+    // Invert the buffer in place, giving up on a hung core or an error flagged in DMASR
+    if (dma_bypass_start(&dev, &buf, &buf, buf_sz) || dma_bypass_wait(&dev, MAX_POLLS))
+        return -1;
+
+    for (i = 0; i < buf_sz; i++) {
+        if (data[i] != (unsigned char)~i)
+            return -1;
+    }
+
+    dma_bypass_buf_del(&dev, &buf);
+    dma_bypass_close(&dev);
+    return 0;
+}
+
+// Invert the largest buffer the core supports, as described by the device tree
+int test_caps(void) {
+    struct dma_proxy_caps caps;
+    struct dma_proxy_buf_req req = {0};
+    struct dma_proxy_xfer xfer;
+    unsigned char *buf;
+    unsigned int i;
+    int fd = open("/dev/dma_proxy", O_RDWR);
+    if (fd < 0)
+        return -1;
+
+    if (ioctl(fd, DMAPROXY_IOCTCAPS, &caps))
+        return -1;
+    if (!caps.max_xfer || !caps.align || caps.addr_width < 32)
+        return -1;
+
+    // Buffers beyond the length registers of the core must be refused
+    req.size = caps.max_xfer + 1;
+    if (!ioctl(fd, DMAPROXY_IOCTBUFNEW, &req))
+        return -1;
+
+    // Keep the test fast on cores with very wide length registers
+    req.size = caps.max_xfer < (1 << 20) ? caps.max_xfer : (1 << 20);
+    if (ioctl(fd, DMAPROXY_IOCTBUFNEW, &req))
+        return -1;
+    buf = (unsigned char *)mmap(NULL, req.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, req.offset);
+    if (buf == MAP_FAILED)
+        return -1;
+    for (i = 0; i < req.size; i++)
+        buf[i] = i * 7;
+
+    xfer.handle = req.handle;
+    xfer.len = req.size;
+    if (ioctl(fd, DMAPROXY_IOCTXFER, &xfer) || ioctl(fd, DMAPROXY_IOCTRXSYNC))
+        return -1;
+    for (i = 0; i < req.size; i++) {
+        if (buf[i] != (unsigned char)~(i * 7))
+            return -1;
+    }
+
+    munmap(buf, req.size);
+    close(fd);
+    return 0;
+}
+
+// Expected result of a transform, computed on the 32-bit words of the buffer
+static unsigned int xform_word(unsigned int op, unsigned int key, unsigned int w, unsigned int *sum) {
+    switch (op) {
+        case DMAPROXY_OP_INVERT:
+            return ~w;
+        case DMAPROXY_OP_BSWAP:
+            return (w >> 24) | ((w >> 8) & 0xFF00) | ((w << 8) & 0xFF0000) | (w << 24);
+        case DMAPROXY_OP_XOR:
+            return w ^ key;
+        default:
+            *sum ^= w;
+            return *sum;
+    }
+}
+
+// Run a buffer through every transform the design supports
+int test_xform(void) {
+    struct dma_proxy_caps caps;
+    struct dma_proxy_buf_req req = {.size = 4096};
+    struct dma_proxy_xfer_op xfer;
+    unsigned int *buf;
+    unsigned int i, op, sum, key = 0x5A3C0F1E;
+    int fd = open("/dev/dma_proxy", O_RDWR);
+    if (fd < 0)
+        return -1;
+
+    if (ioctl(fd, DMAPROXY_IOCTCAPS, &caps) || ioctl(fd, DMAPROXY_IOCTBUFNEW, &req))
+        return -1;
+    // The software model stands in for the transform core, so it runs every transform
+    if ((caps.flags & DMAPROXY_CAP_MODEL) && !(caps.flags & DMAPROXY_CAP_XFORM))
+        return -1;
+    buf = (unsigned int *)mmap(NULL, req.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, req.offset);
+    if (buf == MAP_FAILED)
+        return -1;
+
+    for (op = 0; op < DMAPROXY_NUM_OPS; op++) {
+        for (i = 0; i < req.size / 4; i++)
+            buf[i] = i * 0x9E3779B9;
+
+        xfer.handle = req.handle;
+        xfer.len = req.size;
+        xfer.op = op;
+        xfer.key = op == DMAPROXY_OP_XOR ? key : 0;
+
+        // Without a transform core, only the inversion is available
+        if (op != DMAPROXY_OP_INVERT && !(caps.flags & DMAPROXY_CAP_XFORM)) {
+            if (!ioctl(fd, DMAPROXY_IOCTXFEROP, &xfer) || errno != EOPNOTSUPP)
+                return -1;
+            continue;
+        }
+
+        if (ioctl(fd, DMAPROXY_IOCTXFEROP, &xfer) || ioctl(fd, DMAPROXY_IOCTRXSYNC))
+            return -1;
+        sum = 0;
+        for (i = 0; i < req.size / 4; i++) {
+            if (buf[i] != xform_word(op, key, i * 0x9E3779B9, &sum))
+                return -1;
+        }
+    }
+
+    // Word-wise transforms need whole words
+    xfer.op = DMAPROXY_OP_BSWAP;
+    xfer.key = 0;
+    xfer.len = 6;
+    if (!ioctl(fd, DMAPROXY_IOCTXFEROP, &xfer))
+        return -1;
+
+    munmap(buf, req.size);
+    close(fd);
+    return 0;
+}
+
+// Keep the channels running across transfers of different buffers and sizes, which
+// cycles through the descriptor rings of a core in SG mode more than once
+int test_lease_bufs(void) {
+    struct dma_proxy_buf_req reqs[3];
+    struct dma_proxy_lease lease = {6, 500};
+    struct dma_proxy_xfer xfer;
+    unsigned char *bufs[3];
+    unsigned int i, j, len;
+    int fd = open("/dev/dma_proxy", O_RDWR);
+    if (fd < 0)
+        return -1;
+
+    for (j = 0; j < 3; j++) {
+        reqs[j].size = 4096;
+        reqs[j].rsvd = 0;
+        if (ioctl(fd, DMAPROXY_IOCTBUFNEW, &reqs[j]))
+            return -1;
+        bufs[j] = (unsigned char *)mmap(NULL, reqs[j].size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, reqs[j].offset);
+        if (bufs[j] == MAP_FAILED)
+            return -1;
+    }
+
+    if (ioctl(fd, DMAPROXY_IOCTLEASE, &lease))
+        return -1;
+
+    // Only the first len bytes are inverted, the rest of the buffer must be left alone
+    for (j = 0; j < 6; j++) {
+        len = 1024 * (j % 4 + 1);
+        memset(bufs[j % 3], j, reqs[j % 3].size);
+        xfer.handle = reqs[j % 3].handle;
+        xfer.len = len;
+        if (ioctl(fd, DMAPROXY_IOCTXFER, &xfer) || ioctl(fd, DMAPROXY_IOCTRXSYNC))
+            return -1;
+        for (i = 0; i < reqs[j % 3].size; i++) {
+            if (bufs[j % 3][i] != (unsigned char)(i < len ? ~j : j))
+                return -1;
+        }
+    }
+
+    for (j = 0; j < 3; j++)
+        munmap(bufs[j], reqs[j].size);
+    close(fd);
+    return 0;
+}
+
+// Get the phase timings of a transfer, which must add up to no more than the time around it
+int test_xfer_times(void) {
+    struct dma_proxy_buf_req req = {65536, 0, 0, 0};
+    struct dma_proxy_caps caps;
+    struct dma_proxy_xfer xfer;
+    struct dma_proxy_xfer_times times;
+    struct timespec t0, t1;
+    unsigned long long total;
+    unsigned char *buf;
+    unsigned int i;
+    int fd = open("/dev/dma_proxy", O_RDWR);
+    if (fd < 0)
+        return -1;
+
+    if (ioctl(fd, DMAPROXY_IOCTCAPS, &caps))
+        return -1;
+    if (req.size > caps.max_xfer)
+        req.size = caps.max_xfer;
+    if (ioctl(fd, DMAPROXY_IOCTBUFNEW, &req))
+        return -1;
+    buf = (unsigned char *)mmap(NULL, req.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, req.offset);
+    if (buf == MAP_FAILED)
+        return -1;
+    memset(buf, 0x0F, req.size);
+
+    xfer.handle = req.handle;
+    xfer.len = req.size;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    if (ioctl(fd, DMAPROXY_IOCTXFER, &xfer) || ioctl(fd, DMAPROXY_IOCTRXTIMES, &times))
+        return -1;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    for (i = 0; i < req.size; i++) {
+        if (buf[i] != 0xF0)
+            return -1;
+    }
+
+    // A PL counter runs on its own clock, so only compare against the kernel clock without one
+    total = times.queue_ns + times.setup_ns + times.mm2s_ns + times.s2mm_ns;
+    if (times.err || times.flags != (caps.flags & DMAPROXY_CAP_PLTIME))
+        return -1;
+    if (!(times.flags & DMAPROXY_CAP_PLTIME)
+        && total > (t1.tv_sec - t0.tv_sec) * 1000000000ULL + t1.tv_nsec - t0.tv_nsec)
+        return -1;
+
+    munmap(buf, req.size);
+    close(fd);
+    return 0;
+}
+
+// Queue transfers of two buffers back to back and wait for both with a single sync
+int test_back_to_back(void) {
+    int i, j;
+    struct dma_proxy_buf_req reqs[2];
+    struct dma_proxy_xfer xfer;
+    char *bufs[2];
+    int fd = open("/dev/dma_proxy", O_RDWR);
+    if (fd < 0)
+        return -1;
+
+    for (j = 0; j < 2; j++) {
+        reqs[j].size = 4096;
+        reqs[j].rsvd = 0;
+        if (ioctl(fd, DMAPROXY_IOCTBUFNEW, &reqs[j]))
+            return -1;
+        bufs[j] = (char *)mmap(NULL, reqs[j].size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, reqs[j].offset);
+        if (bufs[j] == MAP_FAILED)
+            return -1;
+        for (i = 0; i < reqs[j].size; i++)
+            bufs[j][i] = 5 * i + j;
+    }
+
+    // The second transfer is started while S2MM of the first may still be in flight
+    for (j = 0; j < 2; j++) {
+        xfer.handle = reqs[j].handle;
+        xfer.len = reqs[j].size;
+        if (ioctl(fd, DMAPROXY_IOCTXFER, &xfer))
+            return -1;
+    }
+    if (ioctl(fd, DMAPROXY_IOCTRXSYNC))
+        return -1;
+    for (j = 0; j < 2; j++) {
+        for (i = 0; i < reqs[j].size; i++) {
+            if (bufs[j][i] != (char)~(5 * i + j))
+                return -1;
+        }
+    }
+
+    for (j = 0; j < 2; j++) {
+        munmap(bufs[j], reqs[j].size);
+        if (ioctl(fd, DMAPROXY_IOCTBUFDEL, &reqs[j].handle))
+            return -1;
+    }
+    close(fd);
+    return 0;
+}
+
+// Invert a buffer through a single io_uring passthrough command
+int test_uring(void) {
+#ifndef HAVE_LIBURING
+    printf("Built without liburing, skipping\n");
+    return 0;
+#else
+    int i;
+    struct io_uring ring;
+    struct io_uring_sqe *sqe;
+    struct io_uring_cqe *cqe;
+    struct dma_proxy_uring_sqe *cmd;
+    struct dma_proxy_buf_req req = {.size = 4096, .rsvd = 0};
+    char *buf;
+    int res;
+    int fd = open("/dev/dma_proxy", O_RDWR);
+    if (fd < 0)
+        return -1;
+
+    if (ioctl(fd, DMAPROXY_IOCTBUFNEW, &req))
+        return -1;
+    buf = (char *)mmap(NULL, req.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, req.offset);
+    if (buf == MAP_FAILED)
+        return -1;
+    for (i = 0; i < req.size; i++)
+        buf[i] = 7 * i;
+
+    if (io_uring_queue_init(4, &ring, 0)) {
+        printf("io_uring not available, skipping\n");
+        goto out;
+    }
+    sqe = io_uring_get_sqe(&ring);
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_URING_CMD;
+    sqe->fd = fd;
+    sqe->cmd_op = DMAPROXY_URING_XFER;
+    cmd = (struct dma_proxy_uring_sqe *)sqe->cmd;
+    cmd->handle = req.handle;
+    cmd->len = req.size;
+    cmd->op = DMAPROXY_OP_INVERT;
+    cmd->key = 0;
+    if (io_uring_submit(&ring) != 1 || io_uring_wait_cqe(&ring, &cqe))
+        return -1;
+    res = cqe->res;
+    io_uring_cqe_seen(&ring, cqe);
+    io_uring_queue_exit(&ring);
+
+    // Kernels before 6.6 and those without IORING_OP_URING_CMD do not pass the command on
+    if (res == -EOPNOTSUPP || res == -EINVAL) {
+        printf("io_uring passthrough not supported by the driver, skipping\n");
+        goto out;
+    }
+    if (res != req.size)
+        return -1;
+    for (i = 0; i < req.size; i++) {
+        if (buf[i] != (char)~(7 * i))
+            return -1;
+    }
+
+out:
+    munmap(buf, req.size);
+    if (ioctl(fd, DMAPROXY_IOCTBUFDEL, &req.handle))
+        return -1;
+    close(fd);
+    return 0;
+#endif
+}
+
+// Read a sysfs attribute into a string, returning zero in case of success
+static int sysfs_read(const char *path, char *val, size_t sz) {
+    ssize_t len;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    len = read(fd, val, sz - 1);
+    close(fd);
+    if (len < 0)
+        return -1;
+    val[len] = 0;
+    return 0;
+}
+
+// Write a string to a sysfs attribute, returning zero in case of success
+static int sysfs_write(const char *path, const char *val) {
+    ssize_t len;
+    int fd = open(path, O_WRONLY);
+    if (fd < 0)
+        return -1;
+
+    len = write(fd, val, strlen(val));
+    close(fd);
+    return len == (ssize_t)strlen(val) ? 0 : -1;
+}
+
+// Stall S2MM of a transfer on the software model, it must time out and the next one succeed
+int test_timeout(void) {
+    int i, err, ret = -1;
+    char timeout[MAX_CHARS];
+    struct dma_proxy_caps caps;
+    struct dma_proxy_buf_req req = {.size = 1024, .rsvd = 0};
+    struct dma_proxy_xfer xfer;
+    unsigned char *buf;
+    int fd = open("/dev/dma_proxy", O_RDWR);
+    if (fd < 0)
+        return -1;
+
+    if (ioctl(fd, DMAPROXY_IOCTCAPS, &caps))
+        return -1;
+    if (!(caps.flags & DMAPROXY_CAP_MODEL)) {
+        printf("Not running on the software model, skipping\n");
+        close(fd);
+        return 0;
+    }
+    if (sysfs_read(PARAMS_DIR "xfer_timeout_ms", timeout, sizeof(timeout))
+        || sysfs_write(PARAMS_DIR "xfer_timeout_ms", "100")) {
+        printf("Module parameters not writable, skipping\n");
+        close(fd);
+        return 0;
+    }
+
+    if (ioctl(fd, DMAPROXY_IOCTBUFNEW, &req))
+        goto out_restore;
+    buf = (unsigned char *)mmap(NULL, req.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, req.offset);
+    if (buf == MAP_FAILED)
+        goto out_restore;
+    xfer.handle = req.handle;
+    xfer.len = req.size;
+
+    // MM2S of the stalled transfer completes, so the timeout is reported when synchronizing
+    if (sysfs_write(PARAMS_DIR "model_stalls", "1"))
+        goto out_unmap;
+    err = (ioctl(fd, DMAPROXY_IOCTXFER, &xfer) || ioctl(fd, DMAPROXY_IOCTRXSYNC)) ? errno : 0;
+    if (err != ETIMEDOUT)
+        goto out_unmap;
+
+    // The core has been reset, so the next transfer goes through
+    memset(buf, 0x0F, req.size);
+    if (ioctl(fd, DMAPROXY_IOCTXFER, &xfer) || ioctl(fd, DMAPROXY_IOCTRXSYNC))
+        goto out_unmap;
+    for (i = 0; i < req.size; i++) {
+        if (buf[i] != 0xF0)
+            goto out_unmap;
+    }
+    ret = 0;
+
+out_unmap:
+    munmap(buf, req.size);
+out_restore:
+    sysfs_write(PARAMS_DIR "model_stalls", "0");
+    sysfs_write(PARAMS_DIR "xfer_timeout_ms", timeout);
+    close(fd);
+    return ret;
+}
+
+// Move the completions to CPU 0 with a real-time policy, read the settings back and transfer
+int test_completion(void) {
+    int i, ret = -1;
+    char cpu[MAX_CHARS], policy[MAX_CHARS], prio[MAX_CHARS], val[MAX_CHARS];
+    size_t buf_sz = 2048;
+    char *buf;
+    int fd = open("/dev/dma_proxy", O_RDWR);
+    if (fd < 0)
+        return -1;
+
+    if (sysfs_read(SYSFS_DIR "completion/cpu", cpu, sizeof(cpu))
+        || sysfs_read(SYSFS_DIR "completion/policy", policy, sizeof(policy))
+        || sysfs_read(SYSFS_DIR "completion/prio", prio, sizeof(prio)))
+        return -1;
+    if (sysfs_write(SYSFS_DIR "completion/cpu", "0")) {
+        if (errno == EACCES || errno == EPERM) {
+            printf("Completion settings not writable, skipping\n");
+            close(fd);
+            return 0;
+        }
+        return -1;
+    }
+
+    // Switching to SCHED_FIFO picks a real-time priority, as the normal one is out of range
+    if (sysfs_write(SYSFS_DIR "completion/policy", "1"))
+        goto out_restore;
+    if (sysfs_read(SYSFS_DIR "completion/cpu", val, sizeof(val)) || atoi(val) != 0)
+        goto out_restore;
+    if (sysfs_read(SYSFS_DIR "completion/policy", val, sizeof(val)) || atoi(val) != 1)
+        goto out_restore;
+    if (sysfs_read(SYSFS_DIR "completion/prio", val, sizeof(val)) || atoi(val) < 1 || atoi(val) > 99)
+        goto out_restore;
+
+    if (ioctl(fd, DMAPROXY_IOCTCBUF, &buf_sz))
+        goto out_restore;
+    buf = (char *)mmap(NULL, buf_sz, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (buf == MAP_FAILED)
+        goto out_restore;
+    for (i = 0; i < buf_sz; i++)
+        buf[i] = 11 * i;
+    if (ioctl(fd, DMAPROXY_IOCTSTART, &buf_sz) || ioctl(fd, DMAPROXY_IOCTRXSYNC))
+        goto out_unmap;
+    for (i = 0; i < buf_sz; i++) {
+        if (buf[i] != (char)~(11 * i))
+            goto out_unmap;
+    }
+    ret = 0;
+
+out_unmap:
+    munmap(buf, buf_sz);
+
+out_restore:
+    sysfs_write(SYSFS_DIR "completion/policy", policy);
+    sysfs_write(SYSFS_DIR "completion/prio", prio);
+    sysfs_write(SYSFS_DIR "completion/cpu", cpu);
+    close(fd);
+    return ret;
+}
+
+// Find the counters of the calling process in stats/clients, returning zero if it is listed
+static int stats_client(long long *xfers, long long *bytes) {
+    char clients[4096];
+    char *line;
+    int slot, pid;
+
+    if (sysfs_read(SYSFS_DIR "stats/clients", clients, sizeof(clients)))
+        return -1;
+    for (line = strtok(clients, "\n"); line; line = strtok(NULL, "\n")) {
+        if (sscanf(line, "%d %d %lld %lld", &slot, &pid, xfers, bytes) == 4 && pid == getpid())
+            return 0;
+    }
+    return -1;
+}
+
+// Run a transfer and check that the counters of the device and of the client advance
+int test_stats(void) {
+    int i;
+    char val[MAX_CHARS];
+    long long xfers, bytes, client_xfers, client_bytes;
+    size_t buf_sz = 1536;
+    char *buf;
+    int fd = open("/dev/dma_proxy", O_RDWR);
+    if (fd < 0)
+        return -1;
+
+    if (ioctl(fd, DMAPROXY_IOCTCBUF, &buf_sz))
+        return -1;
+    buf = (char *)mmap(NULL, buf_sz, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (buf == MAP_FAILED)
+        return -1;
+    for (i = 0; i < buf_sz; i++)
+        buf[i] = 13 * i;
+
+    if (sysfs_read(SYSFS_DIR "stats/xfers", val, sizeof(val)))
+        return -1;
+    xfers = atoll(val);
+    if (sysfs_read(SYSFS_DIR "stats/bytes", val, sizeof(val)))
+        return -1;
+    bytes = atoll(val);
+    if (stats_client(&client_xfers, &client_bytes))
+        return -1;
+
+    if (ioctl(fd, DMAPROXY_IOCTSTART, &buf_sz) || ioctl(fd, DMAPROXY_IOCTRXSYNC))
+        return -1;
+    for (i = 0; i < buf_sz; i++) {
+        if (buf[i] != (char)~(13 * i))
+            return -1;
+    }
+
+    // Other processes may transfer in the meantime, but the client line only counts this one
+    if (sysfs_read(SYSFS_DIR "stats/xfers", val, sizeof(val)) || atoll(val) < xfers + 1)
+        return -1;
+    if (sysfs_read(SYSFS_DIR "stats/bytes", val, sizeof(val)) || atoll(val) < bytes + buf_sz)
+        return -1;
+    xfers = client_xfers;
+    bytes = client_bytes;
+    if (stats_client(&client_xfers, &client_bytes))
+        return -1;
+    if (client_xfers != xfers + 1 || client_bytes != bytes + buf_sz)
+        return -1;
+
+    munmap(buf, buf_sz);
+    close(fd);
+    return 0;
+}
@@ -1,25 +1,104 @@
 #ifndef __TEST_DMA_INV_H_
 #define __TEST_DMA_INV_H_
 
+#include "dma_bypass.h" // Bypass library, also declares the buffer and bypass ioctl structures
+
 /************************************************************************************
 * Test case declarations
 ************************************************************************************/
 int test_max_open(void);
 int test_single_inv(void);
+int test_lease(void);
+int test_multi_buf(void);
+int test_splice(void);
+int test_bypass(void);
+int test_caps(void);
+int test_xform(void);
+int test_lease_bufs(void);
+int test_xfer_times(void);
+int test_back_to_back(void);
+int test_uring(void);
+int test_timeout(void);
+int test_completion(void);
+int test_stats(void);
 
 
 /************************************************************************************
 * Declarations and definitions
 ************************************************************************************/
-#define NUM_TESTS   2
+#define NUM_TESTS   15
 #define MAX_CHARS   100
+#define MAX_POLLS   10000000    // Status reads before a transfer in bypass mode is given up
+#define PARAMS_DIR  "/sys/module/dma_proxy/parameters/"  // Module parameters of the driver
+#define SYSFS_DIR   "/sys/class/dmaprx/dma_proxy/"        // Attributes of the device
 
 #define DMAPROXY_IOCTMAGIC  0x89                                // Magic number
 #define DMAPROXY_IOCTCBUF   _IOW(DMAPROXY_IOCTMAGIC, 0, size_t) // Create a kernel DMA buffer for the process 
 #define DMAPROXY_IOCTRBUF   _IO(DMAPROXY_IOCTMAGIC, 1)          // Remove kernel DMA buffer for process
 #define DMAPROXY_IOCTSTART  _IOW(DMAPROXY_IOCTMAGIC, 2, size_t) // Set up and start a DMA transfer to invert data
 #define DMAPROXY_IOCTSTATUS _IOW(DMAPROXY_IOCTMAGIC, 3, size_t) // Get a vector of status bits
-#define DMAPROXY_IOCTRXSYNC _IO(DMAPROXY_IOCTMAGIC, 4)          // Block until the process-specific RX lock is released
+#define DMAPROXY_IOCTRXSYNC _IO(DMAPROXY_IOCTMAGIC, 4)          // Block until the transfers of the file descriptor have completed
+#define DMAPROXY_IOCTLEASE  _IOW(DMAPROXY_IOCTMAGIC, 6, struct dma_proxy_lease) // Acquire or release exclusive use of the engine
+#define DMAPROXY_IOCTBUFNEW _IOWR(DMAPROXY_IOCTMAGIC, 7, struct dma_proxy_buf_req) // Create a DMA buffer with a free handle
+#define DMAPROXY_IOCTBUFDEL _IOW(DMAPROXY_IOCTMAGIC, 8, unsigned int)   // Remove the DMA buffer with the given handle
+#define DMAPROXY_IOCTXFER   _IOW(DMAPROXY_IOCTMAGIC, 9, struct dma_proxy_xfer)  // Like DMAPROXY_IOCTSTART for any buffer
+#define DMAPROXY_IOCTBUFINFO _IOWR(DMAPROXY_IOCTMAGIC, 10, struct dma_proxy_buf_info)    // Describe a DMA buffer
+#define DMAPROXY_IOCTBYPASS _IOR(DMAPROXY_IOCTMAGIC, 11, struct dma_proxy_bypass_info)  // Take over the core from user space
+#define DMAPROXY_IOCTCAPS   _IOR(DMAPROXY_IOCTMAGIC, 12, struct dma_proxy_caps)  // Describe the capabilities of the core
+#define DMAPROXY_IOCTXFEROP _IOW(DMAPROXY_IOCTMAGIC, 13, struct dma_proxy_xfer_op)  // Like DMAPROXY_IOCTXFER with a transform
+#define DMAPROXY_IOCTRXTIMES _IOR(DMAPROXY_IOCTMAGIC, 14, struct dma_proxy_xfer_times) // Like DMAPROXY_IOCTRXSYNC, with phase timings
+#define DMAPROXY_URING_XFER _IOW(DMAPROXY_IOCTMAGIC, 5, struct dma_proxy_uring_sqe) // io_uring passthrough transfer
+
+#define DMAPROXY_CAP_XFORM  (1 << 2)    // A data_xform core or the software model selects the transform
+#define DMAPROXY_CAP_MODEL  (1 << 3)    // Transfers run on the software model of the core
+#define DMAPROXY_CAP_PLTIME (1 << 4)    // Phase timings are taken from a PL counter
+
+#define DMAPROXY_OP_INVERT  0
+#define DMAPROXY_OP_BSWAP   1
+#define DMAPROXY_OP_XOR     2
+#define DMAPROXY_OP_CSUM    3
+#define DMAPROXY_NUM_OPS    4
+
+struct dma_proxy_xfer {
+    unsigned int handle;
+    unsigned int len;
+};
+
+struct dma_proxy_caps {
+    unsigned long long max_xfer;
+    unsigned int addr_width;
+    unsigned int data_width;
+    unsigned int align;
+    unsigned int flags;
+};
+
+struct dma_proxy_xfer_op {
+    unsigned int handle;
+    unsigned int len;
+    unsigned int op;
+    unsigned int key;
+};
+
+struct dma_proxy_xfer_times {
+    unsigned long long queue_ns;
+    unsigned long long setup_ns;
+    unsigned long long mm2s_ns;
+    unsigned long long s2mm_ns;
+    int err;
+    unsigned int flags;
+};
+
+struct dma_proxy_uring_sqe {
+    unsigned int len;
+    unsigned int handle;
+    unsigned int op;
+    unsigned int key;
+};
+
+struct dma_proxy_lease {
+    unsigned int max_jobs;
+    unsigned int max_ms;
+};
 
 struct test_case {
     int (*func)(void);
@@ -29,7 +108,20 @@ struct test_case {
 // This array contains the individual test cases
 struct test_case test_cases[NUM_TESTS] = {
     {test_max_open, "Maximum number of device opens (test_max_open)"},
-    {test_single_inv, "Single inversion test (test_single_inv)"}
+    {test_single_inv, "Single inversion test (test_single_inv)"},
+    {test_lease, "Inversions under an exclusive lease (test_lease)"},
+    {test_multi_buf, "Several buffers on one file descriptor (test_multi_buf)"},
+    {test_splice, "Splice data through a pipe into and out of a buffer (test_splice)"},
+    {test_bypass, "Inversion with the core programmed from user space (test_bypass)"},
+    {test_caps, "Inversion of the largest buffer described by the device tree (test_caps)"},
+    {test_xform, "Every stream transform of the design (test_xform)"},
+    {test_lease_bufs, "Alternating buffers and sizes under a lease (test_lease_bufs)"},
+    {test_xfer_times, "Phase timings returned with the completion (test_xfer_times)"},
+    {test_back_to_back, "Two buffers in flight on one file descriptor (test_back_to_back)"},
+    {test_uring, "Inversion submitted as an io_uring passthrough command (test_uring)"},
+    {test_timeout, "Recovery from a stalled transfer of the software model (test_timeout)"},
+    {test_completion, "Inversion with completions on CPU 0 under SCHED_FIFO (test_completion)"},
+    {test_stats, "Transfer counters of the device and of the client in sysfs (test_stats)"}
 };
 
 